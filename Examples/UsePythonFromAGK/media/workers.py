@@ -0,0 +1,22 @@
+# Functions run by the worker process pool.  Each takes one bytes argument.
+import array
+
+
+def sum_squares(arg):
+    total = 0
+    for i in range(int(arg)):
+        total += i * i
+    return str(total)
+
+
+def score_positions(arg):
+    # Each record is two floats, x and y.  Returns one float score per record.
+    values = memoryview(arg).cast('f')
+    scores = array.array('f')
+    for index in range(0, len(values), 2):
+        x, y = values[index], values[index + 1]
+        total = 0.0
+        for k in range(20):
+            total += (x * k - y) ** 2
+        scores.append(total)
+    return scores
@@ -0,0 +1,362 @@
+/*
+Copyright (c) 2017 Adam Biser <adambiser@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+Imports from AGK media.
+
+The built-in agkimport module adds a meta path finder that loads modules through AGK's file commands, so scripts can
+ship inside the game's media folder or in a zip in it without being extracted first:
+
+	import agkimport
+	agkimport.add_path("scripts")			# A media folder.
+	agkimport.add_path("mods/extra.zip")	# A zip, read into memory once.
+	import enemy_ai							# scripts/enemy_ai.py
+
+AGK script does the same with PyImport_AddAgkPath before running Python.  Paths are relative to the media root.
+
+Folder listings and zip name lists are cached, so a lookup that misses costs a set lookup after the first import from
+a folder.  agkimport.invalidate_caches, which importlib.invalidate_caches also calls, clears the folder listings.
+The finder runs after the standard ones, so it never shadows the standard library.
+
+AGK commands can only be called from the AGK main thread, so imports from other threads skip the finder.
+*/
+
+#include <string>
+
+#include "PythonPlugin.h"
+#include "PythonErrorHandling.h"
+#include "PythonThreading.h"
+#include "PluginHelpers.h"
+#ifdef PLUGIN
+#include "..\AGKLibraryCommands.h"
+#endif
+
+// The finder itself.  It calls list_dir and read_file below.
+static const char *AgkImportSource = R"PY(
+import sys
+
+_paths = []
+
+
+def _join(*parts):
+    return "/".join(part for part in parts if part)
+
+
+class _Folder:
+    def __init__(self, path):
+        self.path = path.strip("/")
+        self.listings = {}
+
+    def _listing(self, folder):
+        listing = self.listings.get(folder)
+        if listing is None:
+            files, folders = list_dir(_join(self.path, folder))
+            listing = self.listings[folder] = (frozenset(files), frozenset(folders))
+        return listing
+
+    def find(self, fullname):
+        parts = fullname.split(".")
+        folder = "/".join(parts[:-1])
+        files, folders = self._listing(folder)
+        name = parts[-1]
+        if name in folders and "__init__.py" in self._listing(_join(folder, name))[0]:
+            return _join(folder, name, "__init__.py"), True
+        if name + ".py" in files:
+            return _join(folder, name + ".py"), False
+        return None
+
+    def read(self, relpath):
+        return read_file(_join(self.path, relpath))
+
+    def invalidate(self):
+        self.listings.clear()
+
+
+class _Zip:
+    def __init__(self, path):
+        import io, zipfile
+        self.path = path.strip("/")
+        self.zip = zipfile.ZipFile(io.BytesIO(read_file(self.path)))
+        self.names = frozenset(self.zip.namelist())
+
+    def find(self, fullname):
+        base = fullname.replace(".", "/")
+        if base + "/__init__.py" in self.names:
+            return base + "/__init__.py", True
+        if base + ".py" in self.names:
+            return base + ".py", False
+        return None
+
+    def read(self, relpath):
+        return self.zip.read(relpath)
+
+    def invalidate(self):
+        pass
+
+
+class _Loader:
+    def __init__(self, source, relpath):
+        self.source = source
+        self.relpath = relpath
+        self.origin = "agk:" + _join(source.path, relpath)
+
+    def create_module(self, spec):
+        return None
+
+    def exec_module(self, module):
+        code = compile(self.source.read(self.relpath), self.origin, "exec", dont_inherit=True)
+        exec(code, module.__dict__)
+
+    def get_source(self, fullname):
+        import io
+        from tokenize import detect_encoding
+        data = self.source.read(self.relpath)
+        encoding = detect_encoding(io.BytesIO(data).readline)[0]
+        return data.decode(encoding)
+
+
+class _Finder:
+    @classmethod
+    def find_spec(cls, fullname, path=None, target=None):
+        if not is_main_thread():
+            return None
+        for source in _paths:
+            found = source.find(fullname)
+            if found:
+                from importlib.machinery import ModuleSpec
+                relpath, is_package = found
+                loader = _Loader(source, relpath)
+                spec = ModuleSpec(fullname, loader, origin=loader.origin, is_package=is_package)
+                spec.has_location = True
+                return spec
+        return None
+
+    @classmethod
+    def invalidate_caches(cls):
+        for source in _paths:
+            source.invalidate()
+
+
+def add_path(path):
+    """add_path(path)
+
+    Adds a media folder or .zip file to search for modules.  A path that was already added is ignored."""
+    if any(source.path == path.strip("/") for source in _paths):
+        return
+    _paths.append(_Zip(path) if path.lower().endswith(".zip") else _Folder(path))
+    if _Finder not in sys.meta_path:
+        sys.meta_path.append(_Finder)
+
+
+def clear_paths():
+    """clear_paths()
+
+    Removes every path and the finder."""
+    del _paths[:]
+    if _Finder in sys.meta_path:
+        sys.meta_path.remove(_Finder)
+
+
+def invalidate_caches():
+    """invalidate_caches()
+
+    Forgets the cached folder listings."""
+    _Finder.invalidate_caches()
+)PY";
+
+// Appends each name from an AGK GetFirst/GetNext listing to a list.
+static bool AppendNames(PyObject *list, char *name, char *(*next)())
+{
+	bool ok = true;
+	while (name && *name)
+	{
+		PyObject *item = PyUnicode_FromString(name);
+		ok = ok && item && PyList_Append(list, item) == 0;
+		Py_XDECREF(item);
+		agk::DeleteString(name);
+		name = next();
+	}
+	if (name)
+	{
+		agk::DeleteString(name);
+	}
+	return ok;
+}
+
+/*
+list_dir(path) -> (files, folders)
+Lists a media folder.  A folder that doesn't exist is empty.  AGK's current folder is restored afterwards.
+*/
+static PyObject *agkimport_list_dir(PyObject *self, PyObject *args)
+{
+	const char *path;
+	if (!PyArg_ParseTuple(args, "s:list_dir", &path) || !CheckMainThread("agkimport", "list_dir"))
+	{
+		return NULL;
+	}
+	char *current = agk::GetFolder();
+	std::string previous = "/";
+	previous += (current) ? current : "";
+	if (current)
+	{
+		agk::DeleteString(current);
+	}
+	PyObject *files = PyList_New(0);
+	PyObject *folders = PyList_New(0);
+	std::string folder = "/";
+	folder += path;
+	bool ok = files && folders;
+	if (ok && agk::SetFolder(folder.c_str()))
+	{
+		// Mode 2 lists both the read-only media folder and the write folder.
+		ok = AppendNames(files, agk::GetFirstFile(2), agk::GetNextFile)
+			&& AppendNames(folders, agk::GetFirstFolder(2), agk::GetNextFolder);
+	}
+	agk::SetFolder(previous.c_str());
+	if (!ok)
+	{
+		Py_XDECREF(files);
+		Py_XDECREF(folders);
+		return NULL;
+	}
+	return Py_BuildValue("(NN)", files, folders);
+}
+
+/*
+read_file(path) -> bytes
+Reads a whole media file with CreateMemblockFromFile.  The path is relative to the media root.
+*/
+static PyObject *agkimport_read_file(PyObject *self, PyObject *args)
+{
+	const char *path;
+	if (!PyArg_ParseTuple(args, "s:read_file", &path) || !CheckMainThread("agkimport", "read_file"))
+	{
+		return NULL;
+	}
+	// A leading slash makes the path relative to the media root instead of AGK's current folder.
+	std::string file = "/";
+	file += path;
+	if (!agk::GetFileExists(file.c_str()))
+	{
+		PyErr_Format(PyExc_FileNotFoundError, "agkimport: '%s' does not exist.", path);
+		return NULL;
+	}
+	// AGK can't create an empty memblock, so an empty file such as a package's __init__.py is read without one.
+	unsigned int fileID = agk::OpenToRead(file.c_str());
+	int size = (fileID) ? agk::GetFileSize(fileID) : -1;
+	if (fileID)
+	{
+		agk::CloseFile(fileID);
+	}
+	if (size == 0)
+	{
+		return PyBytes_FromStringAndSize(NULL, 0);
+	}
+	unsigned int memID = agk::CreateMemblockFromFile(file.c_str());
+	if (memID == 0)
+	{
+		PyErr_Format(PyExc_OSError, "agkimport: Could not read '%s'.", path);
+		return NULL;
+	}
+	PyObject *data = PyBytes_FromStringAndSize((const char *)agk::GetMemblockPtr(memID), agk::GetMemblockSize(memID));
+	agk::DeleteMemblock(memID);
+	return data;
+}
+
+static PyObject *agkimport_is_main_thread(PyObject *self, PyObject *unused)
+{
+	return PyBool_FromLong(IsMainThread());
+}
+
+static PyMethodDef AgkImportMethods[] = {
+	{ "list_dir", agkimport_list_dir, METH_VARARGS, "list_dir(path)\n\nReturns the files and folders in a media folder." },
+	{ "read_file", agkimport_read_file, METH_VARARGS, "read_file(path)\n\nReturns the contents of a media file." },
+	{ "is_main_thread", agkimport_is_main_thread, METH_NOARGS, "is_main_thread()\n\nWhether this is the AGK main thread." },
+	{ NULL, NULL, 0, NULL }
+};
+
+static PyModuleDef AgkImportModule = {
+	PyModuleDef_HEAD_INIT, "agkimport", "Imports modules from AGK media folders and zips.", -1, AgkImportMethods
+};
+
+static PyObject *PyInit_agkimport()
+{
+	PyObject *module = PyModule_Create(&AgkImportModule);
+	if (module == NULL)
+	{
+		return NULL;
+	}
+	PyObject *dict = PyModule_GetDict(module);
+	if (PyDict_SetItemString(dict, "__builtins__", PyEval_GetBuiltins()) == -1)
+	{
+		Py_DECREF(module);
+		return NULL;
+	}
+	PyObject *result = PyRun_String(AgkImportSource, Py_file_input, dict, dict);
+	if (result == NULL)
+	{
+		Py_DECREF(module);
+		return NULL;
+	}
+	Py_DECREF(result);
+	return module;
+}
+
+void RegisterAgkImportModule()
+{
+	RegisterBuiltinModule("agkimport", PyInit_agkimport);
+}
+
+static PyObject *CallAgkImport(const char *function, const char *path)
+{
+	PyObject *module = PyImport_ImportModule("agkimport");
+	if (module == NULL)
+	{
+		return NULL;
+	}
+	PyObject *result = (path) ? PyObject_CallMethod(module, function, "s", path)
+		: PyObject_CallMethod(module, function, NULL);
+	Py_DECREF(module);
+	return result;
+}
+
+/*
+Adds a media folder or .zip file to search for Python modules.
+*/
+void PyImport_AddAgkPath(const char *path)
+{
+	HOLD_GIL
+	PyObject *result = CallAgkImport("add_path", path);
+	Py_XDECREF(result);
+	CheckError();
+}
+
+/*
+Removes every media path added with PyImport_AddAgkPath.
+*/
+void PyImport_ClearAgkPaths()
+{
+	HOLD_GIL
+	PyObject *result = CallAgkImport("clear_paths", NULL);
+	Py_XDECREF(result);
+	CheckError();
+}
@@ -0,0 +1,251 @@
+/*
+Copyright (c) 2017 Adam Biser <adambiser@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+Built-in agk module.
+
+Exposes AGK commands to Python so that game logic can call them directly:
+
+	import agk
+	agk.SetSpritePosition(sprite, x, y)
+	if agk.GetRawKeyPressed(32):
+		...
+
+Each function is a METH_FASTCALL thunk that converts its arguments with the To* helpers below and calls the agk::
+wrapper, so a call costs one C function call and no argument tuple.  Commands with overloads pick one by the
+number of arguments and then by their types.  Strings returned by AGK are copied and then deleted.
+
+The thunks are generated into AgkBindings.inc by ../generate_bindings.py.  Every command in AGKLibraryCommands.h
+that only takes and returns numbers and strings is included.  Hand-written batch commands that work on buffers of
+IDs are added from SpriteBatch.cpp, input snapshots from InputSnapshot.cpp, batch raycasts from RaycastBatch.cpp and
+batch tweens from TweenBatch.cpp.
+The agk.SpatialHash and agk.MessageSchema types are in SpatialHash.cpp and MessageSchema.cpp, and the
+agk.BudgetExceededError exception is in Watchdog.cpp.
+
+AGK commands can only be called from the AGK main thread.  Calling one from another Python thread raises
+RuntimeError.
+*/
+
+#include <cstring>
+#include <string>
+
+#include "AgkModule.h"
+#include "PythonPlugin.h"
+#include "PythonErrorHandling.h"
+#include "PythonThreading.h"
+#include "PluginHelpers.h"
+#ifdef PLUGIN
+#include "..\AGKLibraryCommands.h"
+#endif
+
+bool CheckCall(const char *name, Py_ssize_t nargs, Py_ssize_t min, Py_ssize_t max, PyObject *kwnames)
+{
+	if (!CheckMainThread("agk", name))
+	{
+		return false;
+	}
+	if (kwnames != NULL && PyTuple_GET_SIZE(kwnames) != 0)
+	{
+		PyErr_Format(PyExc_TypeError, "agk.%s does not take keyword arguments.", name);
+		return false;
+	}
+	if (nargs < min || nargs > max)
+	{
+		if (min == max)
+		{
+			PyErr_Format(PyExc_TypeError, "agk.%s takes %zd arguments (%zd given).", name, min, nargs);
+		}
+		else
+		{
+			PyErr_Format(PyExc_TypeError, "agk.%s takes %zd to %zd arguments (%zd given).", name, min, max, nargs);
+		}
+		return false;
+	}
+	return true;
+}
+
+/*
+Buffer arguments.
+*/
+static const char *GetBufferTypeName(char type)
+{
+	switch (type)
+	{
+	case 'i':
+		return "32-bit integers";
+	case 'f':
+		return "32-bit floats";
+	default:
+		return "bytes";
+	}
+}
+
+// Whether a buffer's struct format describes 4-byte integers, 4-byte floats or bytes.
+static bool MatchesBufferType(const Py_buffer &view, char type)
+{
+	const char *format = (view.format) ? view.format : "B";
+	if (*format == '@' || *format == '=' || *format == '<')
+	{
+		format++;
+	}
+	if (format[0] == 0 || format[1] != 0)
+	{
+		return false;
+	}
+	switch (type)
+	{
+	case 'i':
+		return view.itemsize == 4 && strchr("iIlL", format[0]) != NULL;
+	case 'f':
+		return view.itemsize == 4 && format[0] == 'f';
+	default:
+		return view.itemsize == 1 && strchr("bBc", format[0]) != NULL;
+	}
+}
+
+bool BufferArg::Get(PyObject *arg, char type, bool writable, const char *function, int index)
+{
+	int flags = PyBUF_FORMAT | PyBUF_C_CONTIGUOUS | ((writable) ? PyBUF_WRITABLE : 0);
+	if (PyObject_GetBuffer(arg, &m_View, flags) == -1)
+	{
+		PyErr_Format(PyExc_TypeError, "agk.%s: Argument %d must be a contiguous%s buffer of %s.", function, index + 1,
+			(writable) ? " writable" : "", GetBufferTypeName(type));
+		return false;
+	}
+	if (!MatchesBufferType(m_View, type))
+	{
+		PyErr_Format(PyExc_TypeError, "agk.%s: Argument %d must be a buffer of %s, not format '%s'.", function,
+			index + 1, GetBufferTypeName(type), (m_View.format) ? m_View.format : "B");
+		return false;
+	}
+	data = m_View.buf;
+	count = m_View.len / m_View.itemsize;
+	return true;
+}
+
+bool FloatArg::Get(PyObject *arg, const char *function, int index)
+{
+	if (PyFloat_Check(arg) || PyLong_Check(arg))
+	{
+		m_Data = NULL;
+		return ToFloat(arg, m_Scalar);
+	}
+	if (!m_Buffer.Get(arg, 'f', false, function, index))
+	{
+		return false;
+	}
+	m_Data = (const float *)m_Buffer.data;
+	count = m_Buffer.count;
+	return true;
+}
+
+bool CheckBatchCount(const char *function, int index, Py_ssize_t count, Py_ssize_t expected)
+{
+	if (count < expected)
+	{
+		PyErr_Format(PyExc_ValueError, "agk.%s: Argument %d has %zd items but %zd are needed.", function, index + 1,
+			count, expected);
+		return false;
+	}
+	return true;
+}
+
+PyObject *GetAgkObject(int handle, destructor dealloc, const char *typeName, const char *caller)
+{
+	PyObject *object = GetPyObject(handle);
+	// PyInit_agk creates new type objects after every Py_Initialize (sub-interpreters share them through the copy of
+	// the module's dict that Python keeps for m_size -1 modules), so check the type by its dealloc function.
+	if (object != NULL && Py_TYPE(object)->tp_dealloc == dealloc)
+	{
+		return object;
+	}
+	std::string msg = caller;
+	if (handle == 0)
+	{
+		msg += ": Given required handle was null.";
+	}
+	else
+	{
+		msg += ": The object is not a ";
+		msg += typeName;
+		msg += ".";
+	}
+	agk::PluginError(msg.c_str());
+	return NULL;
+}
+
+int NewAgkObject(const char *typeName, PyObject *args)
+{
+	PyObject *object = NULL;
+	PyObject *module = (args) ? PyImport_ImportModule("agk") : NULL;
+	if (module != NULL)
+	{
+		PyObject *type = PyObject_GetAttrString(module, typeName);
+		if (type != NULL)
+		{
+			object = PyObject_Call(type, args, NULL);
+			Py_DECREF(type);
+		}
+		Py_DECREF(module);
+	}
+	Py_XDECREF(args);
+	if (object == NULL)
+	{
+		CheckError();
+		return 0;
+	}
+	return GetHandle(object);
+}
+
+// The thunks and the AgkMethods table.
+#include "AgkBindings.inc"
+
+static PyModuleDef AgkModule = {
+	PyModuleDef_HEAD_INIT, "agk", "AGK commands.", -1, AgkMethods
+};
+
+static PyObject *PyInit_agk()
+{
+	PyObject *module = PyModule_Create(&AgkModule);
+	if (module == NULL)
+	{
+		return NULL;
+	}
+	if (PyModule_AddFunctions(module, SpriteBatchMethods) == -1
+		|| PyModule_AddFunctions(module, InputSnapshotMethods) == -1
+		|| PyModule_AddFunctions(module, RaycastBatchMethods) == -1
+		|| PyModule_AddFunctions(module, TweenBatchMethods) == -1
+		|| AddInputSnapshotConstants(module) == -1
+		|| AddSpatialHashType(module) == -1
+		|| AddMessageSchemaType(module) == -1
+		|| AddBudgetExceededError(module) == -1)
+	{
+		Py_DECREF(module);
+		return NULL;
+	}
+	return module;
+}
+
+void RegisterAgkModule()
+{
+	RegisterBuiltinModule("agk", PyInit_agk);
+}
@@ -0,0 +1,157 @@
+/*
+Copyright (c) 2017 Adam Biser <adambiser@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef AGK_MODULE_H_
+#define AGK_MODULE_H_
+
+#include "PluginHelpers.h"
+#ifdef PLUGIN
+#include "..\AGKLibraryCommands.h"
+#endif
+
+/*
+Helpers for the functions of the built-in agk module.  See AgkModule.cpp.
+*/
+
+/*
+Thunk signature.  Python 3.6's METH_FASTCALL also passes keyword names, which AGK commands don't accept.
+*/
+#if PY_VERSION_HEX >= 0x03070000
+#define AGK_THUNK(name)				static PyObject *agk_##name(PyObject *self, PyObject *const *args, Py_ssize_t nargs)
+#define AGK_BEGIN(name, min, max)	if (!CheckCall(#name, nargs, min, max, NULL)) return NULL;
+#else
+#define AGK_THUNK(name)				static PyObject *agk_##name(PyObject *self, PyObject **args, Py_ssize_t nargs, PyObject *kwnames)
+#define AGK_BEGIN(name, min, max)	if (!CheckCall(#name, nargs, min, max, kwnames)) return NULL;
+#endif
+#define AGK_METHOD(name, doc)		{ #name, (PyCFunction)agk_##name, METH_FASTCALL, doc }
+
+// Checks the calling thread, keyword arguments and the argument count.  Sets a Python exception and returns false
+// on failure.
+bool CheckCall(const char *name, Py_ssize_t nargs, Py_ssize_t min, Py_ssize_t max, PyObject *kwnames);
+
+/*
+Argument conversion.  Each returns false with a Python exception set when the argument has the wrong type.
+*/
+static inline bool ToInt(PyObject *arg, int &value)
+{
+	long result = PyLong_AsLong(arg);
+	value = (int)result;
+	return !(result == -1 && PyErr_Occurred());
+}
+
+// IDs are unsigned in AGK but plain integers in Python.
+static inline bool ToUInt(PyObject *arg, unsigned int &value)
+{
+	long result = PyLong_AsLong(arg);
+	value = (unsigned int)result;
+	return !(result == -1 && PyErr_Occurred());
+}
+
+static inline bool ToFloat(PyObject *arg, float &value)
+{
+	if (PyFloat_CheckExact(arg))
+	{
+		value = (float)PyFloat_AS_DOUBLE(arg);
+		return true;
+	}
+	double result = PyFloat_AsDouble(arg);
+	value = (float)result;
+	return !(result == -1.0 && PyErr_Occurred());
+}
+
+static inline bool ToString(PyObject *arg, const char *&value)
+{
+	value = PyUnicode_AsUTF8(arg);
+	return value != NULL;
+}
+
+// Takes ownership of a string returned by AGK.
+static inline PyObject *FromString(char *text)
+{
+	if (text == NULL)
+	{
+		return PyUnicode_FromString("");
+	}
+	PyObject *result = PyUnicode_FromString(text);
+	agk::DeleteString(text);
+	return result;
+}
+
+/*
+Batch commands take their per-item values as buffers, such as array.array, bytearray, memoryview or numpy arrays.
+Types are 'i' for 32-bit integers, 'f' for 32-bit floats and 'B' for bytes.  Get sets a Python exception naming the
+function and argument and returns false on failure.
+*/
+class BufferArg
+{
+public:
+	BufferArg() : data(NULL), count(0) { m_View.obj = NULL; }
+	~BufferArg() { if (m_View.obj) PyBuffer_Release(&m_View); }
+	bool Get(PyObject *arg, char type, bool writable, const char *function, int index);
+	void *data;
+	Py_ssize_t count;
+private:
+	Py_buffer m_View;
+};
+
+// A buffer of floats or a single number that applies to every item.
+class FloatArg
+{
+public:
+	FloatArg() : count(PY_SSIZE_T_MAX), m_Data(NULL), m_Scalar(0) {}
+	bool Get(PyObject *arg, const char *function, int index);
+	float operator[](Py_ssize_t index) const { return (m_Data) ? m_Data[index] : m_Scalar; }
+	Py_ssize_t count;
+private:
+	BufferArg m_Buffer;
+	const float *m_Data;
+	float m_Scalar;
+};
+
+// Sets ValueError and returns false when a value argument has fewer items than there are IDs.
+bool CheckBatchCount(const char *function, int index, Py_ssize_t count, Py_ssize_t expected);
+
+/*
+Objects of the agk module's types that AGK script uses through handles.
+*/
+// Returns the object for a handle if its type has the given dealloc function, or reports an error and returns NULL.
+// Null handles are reported like REQUIRED_HANDLE does, so the caller returns its own error value for them.
+PyObject *GetAgkObject(int handle, destructor dealloc, const char *typeName, const char *caller);
+// Creates an agk.<typeName>(*args) and returns its handle.  Steals args, which may be NULL when building it failed.
+// Reports errors with CheckError and returns 0.
+int NewAgkObject(const char *typeName, PyObject *args);
+
+// Extra agk module functions, added when the module is created.
+extern PyMethodDef SpriteBatchMethods[];	// SpriteBatch.cpp
+extern PyMethodDef InputSnapshotMethods[];	// InputSnapshot.cpp
+extern PyMethodDef RaycastBatchMethods[];	// RaycastBatch.cpp
+extern PyMethodDef TweenBatchMethods[];		// TweenBatch.cpp
+// Adds the INPUT_* layout constants.  Returns -1 with a Python exception set on failure.
+int AddInputSnapshotConstants(PyObject *module);
+// Adds agk.SpatialHash, see SpatialHash.cpp.  Returns -1 with a Python exception set on failure.
+int AddSpatialHashType(PyObject *module);
+// Adds agk.MessageSchema, see MessageSchema.cpp.  Returns -1 with a Python exception set on failure.
+int AddMessageSchemaType(PyObject *module);
+// Adds agk.BudgetExceededError, see Watchdog.cpp.  Returns -1 with a Python exception set on failure.
+int AddBudgetExceededError(PyObject *module);
+
+#endif // AGK_MODULE_H_
@@ -0,0 +1,617 @@
+/*
+Copyright (c) 2017 Adam Biser <adambiser@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+Asynchronous script execution.
+
+PyRun_StringAsync, PyRun_FileAsync and PyObject_CallAsync queue work for a plugin-owned worker thread and return a
+job id right away.  The worker takes the GIL while it runs a job, so the AGK main thread only waits for the GIL while
+a plugin call is touching Python.  Python code running on the worker should not call AGK commands.
+
+Poll a job with PyJob_GetState, then collect it with PyJob_GetResult, which also reports any Python error the job
+raised.  A job id is freed once PyJob_GetResult has been called for it or when a pending job is cancelled.
+
+PyImport_Prefetch uses the same worker to import modules ahead of time, so the main thread later finds them in
+sys.modules.
+
+A job runs in the interpreter that was active when it was queued, with a thread state of its own.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "PythonPlugin.h"
+#include "PythonErrorHandling.h"
+#include "PythonThreading.h"
+#include "PluginHelpers.h"
+#ifdef PLUGIN
+#include "..\AGKLibraryCommands.h"
+#endif
+
+enum JobState
+{
+	JOB_CANCELLED = -2,
+	JOB_FAILED = -1,
+	JOB_UNKNOWN = 0,
+	JOB_PENDING = 1,
+	JOB_RUNNING = 2,
+	JOB_DONE = 3,
+};
+
+#define JOB_STOP_TIMEOUT_MS	2000 // How long destroying an interpreter waits for its running job.
+
+enum JobKind
+{
+	JOB_RUN_STRING,
+	JOB_RUN_FILE,
+	JOB_CALL,
+	JOB_IMPORT,
+};
+
+struct AsyncJob
+{
+	JobKind kind;
+	std::string text; // script, filename or module name
+	// Strong refs.  The callable, args and kw are used by JOB_CALL.  The globals and locals by the run jobs.
+	PyObject *callable;
+	PyObject *args;
+	PyObject *kw;
+	PyObject *globals;
+	PyObject *locals;
+	// Set by the worker before the state becomes JOB_DONE or JOB_FAILED.
+	PyObject *result;
+	PyObject *errorType;
+	PyObject *errorValue;
+	PyObject *errorTraceback;
+	std::atomic<int> state;
+	std::atomic<bool> cancelRequested;
+	// Written by the worker while it holds the GIL.  Read by the main thread with or without it.
+	std::atomic<unsigned long> threadId;
+	// The interpreter the job runs in.
+	int interpreter;
+	PyInterpreterState *interpreterState;
+
+	// Requires the GIL.
+	AsyncJob(JobKind kind) : kind(kind), callable(NULL), args(NULL), kw(NULL), globals(NULL), locals(NULL),
+		result(NULL), errorType(NULL), errorValue(NULL), errorTraceback(NULL), state(JOB_PENDING), cancelRequested(false), threadId(0),
+		interpreter(PyInterp_GetCurrent()), interpreterState(PyThreadState_Get()->interp)
+	{
+	}
+
+	// Requires the GIL.
+	void Release()
+	{
+		Py_CLEAR(callable);
+		Py_CLEAR(args);
+		Py_CLEAR(kw);
+		Py_CLEAR(globals);
+		Py_CLEAR(locals);
+		Py_CLEAR(result);
+		Py_CLEAR(errorType);
+		Py_CLEAR(errorValue);
+		Py_CLEAR(errorTraceback);
+	}
+};
+
+// The job map is only used by the main thread.  The queue is shared with the worker.
+std::map<int, AsyncJob *> m_Jobs;
+int m_NextJobID = 1;
+std::deque<AsyncJob *> m_JobQueue;
+std::mutex m_JobMutex;
+std::condition_variable m_JobAvailable;
+std::thread m_JobWorker;
+std::atomic<bool> m_StopJobWorker(false);
+
+static PyObject *RunJob(AsyncJob *job)
+{
+	switch (job->kind)
+	{
+	case JOB_RUN_STRING:
+		return PyRun_String(job->text.c_str(), Py_file_input, job->globals, job->locals);
+	case JOB_RUN_FILE:
+		if (FILE *fp = _Py_fopen(job->text.c_str(), "r"))
+		{
+			return PyRun_FileExFlags(fp, job->text.c_str(), Py_file_input, job->globals, job->locals, 1, NULL);
+		}
+		PyErr_Format(PyExc_IOError, "Failed to open file: %s", job->text.c_str());
+		return NULL;
+	case JOB_CALL:
+		return PyObject_Call(job->callable, job->args, job->kw);
+	case JOB_IMPORT:
+		return PyImport_ImportModule(job->text.c_str());
+	}
+	return NULL;
+}
+
+static void JobWorkerMain()
+{
+	while (true)
+	{
+		AsyncJob *job;
+		{
+			std::unique_lock<std::mutex> lock(m_JobMutex);
+			m_JobAvailable.wait(lock, [] { return m_StopJobWorker || !m_JobQueue.empty(); });
+			if (m_StopJobWorker)
+			{
+				return;
+			}
+			job = m_JobQueue.front();
+			m_JobQueue.pop_front();
+			// Set while holding the lock so cancelling can't race with starting.
+			job->state = JOB_RUNNING;
+		}
+		// PyGILState_Ensure would always use the main interpreter.
+		PyThreadState *threadState = PyThreadState_New(job->interpreterState);
+		PyEval_RestoreThread(threadState);
+		job->threadId = threadState->thread_id;
+		PyObject *result = NULL;
+		if (!job->cancelRequested)
+		{
+			result = RunJob(job);
+		}
+		bool succeeded = (result != NULL);
+		if (!succeeded)
+		{
+			PyErr_Fetch(&job->errorType, &job->errorValue, &job->errorTraceback);
+		}
+		else if (job->kind == JOB_IMPORT)
+		{
+			// sys.modules holds the module now.  The job doesn't need to keep it alive.
+			Py_DECREF(result);
+		}
+		else
+		{
+			job->result = result;
+		}
+		job->threadId = 0;
+		PyThreadState_Clear(threadState);
+		PyThreadState_DeleteCurrent();
+		job->state = (job->cancelRequested) ? JOB_CANCELLED : (succeeded) ? JOB_DONE : JOB_FAILED;
+		// Shutting down interrupts the running job with KeyboardInterrupt, which the job may have swallowed or
+		// turned into an ordinary failure, so check for the stop request after every job.
+		if (m_StopJobWorker)
+		{
+			return;
+		}
+	}
+}
+
+static int QueueJob(AsyncJob *job)
+{
+	if (!m_JobWorker.joinable())
+	{
+		m_StopJobWorker = false;
+		m_JobWorker = std::thread(JobWorkerMain);
+	}
+	int id = m_NextJobID++;
+	m_Jobs[id] = job;
+	{
+		std::lock_guard<std::mutex> lock(m_JobMutex);
+		m_JobQueue.push_back(job);
+	}
+	m_JobAvailable.notify_one();
+	return id;
+}
+
+static AsyncJob *GetJob(int job, const char *caller)
+{
+	auto found = m_Jobs.find(job);
+	if (found == m_Jobs.end())
+	{
+		std::string msg = caller;
+		msg += ": Invalid job id.";
+		agk::PluginError(msg.c_str());
+		return NULL;
+	}
+	return found->second;
+}
+
+static void DeleteJob(int id, AsyncJob *job)
+{
+	{
+		ScopedInterpreter scope(job->interpreter);
+		job->Release();
+	}
+	delete job;
+	m_Jobs.erase(id);
+}
+
+// Raises KeyboardInterrupt in a running job.
+static void InterruptJob(AsyncJob *job)
+{
+	// The worker is blocked on the GIL we're holding or is running Python code, so threadId is stable here.
+	if (unsigned long threadId = job->threadId)
+	{
+		// Only finds threads of the active interpreter.
+		ScopedInterpreter scope(job->interpreter);
+		PyThreadState_SetAsyncExc(threadId, PyExc_KeyboardInterrupt);
+	}
+}
+
+static AsyncJob *CreateRunJob(JobKind kind, const char *text, int hglobals, int hlocals)
+{
+	AsyncJob *job = new AsyncJob(kind);
+	job->text = text;
+	// If globals and/or locals aren't provided, use an empty dict for them.
+	job->globals = (hglobals) ? GetPyObject(hglobals) : PyDict_New();
+	job->locals = (hlocals) ? GetPyObject(hlocals) : PyDict_New();
+	// Keep the given dicts alive while the job is queued.
+	if (hglobals)
+	{
+		Py_XINCREF(job->globals);
+	}
+	if (hlocals)
+	{
+		Py_XINCREF(job->locals);
+	}
+	return job;
+}
+
+int _PyRun_StringAsync(char *script, int hglobals, int hlocals)
+{
+	HOLD_GIL
+	return QueueJob(CreateRunJob(JOB_RUN_STRING, script, hglobals, hlocals));
+}
+
+int _PyRun_FileAsync(const char *filename, int hglobals, int hlocals)
+{
+	HOLD_GIL
+	return QueueJob(CreateRunJob(JOB_RUN_FILE, filename, hglobals, hlocals));
+}
+
+int _PyObject_CallAsync(int hcallable_object, int hargs, int hkw)
+{
+	HOLD_GIL
+	REQUIRED_HANDLE(hcallable_object)
+	AsyncJob *job = new AsyncJob(JOB_CALL);
+	job->callable = GetPyObject(hcallable_object);
+	Py_XINCREF(job->callable);
+	// args must not be NULL, use an empty tuple if no arguments are needed.
+	if (hargs)
+	{
+		job->args = GetPyObject(hargs);
+		Py_XINCREF(job->args);
+	}
+	else
+	{
+		job->args = PyTuple_New(0);
+	}
+	job->kw = GetPyObject(hkw);
+	Py_XINCREF(job->kw);
+	return QueueJob(job);
+}
+
+/*
+Returns one of: -2 = cancelled, -1 = failed, 0 = unknown job, 1 = pending, 2 = running, 3 = done.
+*/
+int PyJob_GetState(int job)
+{
+	auto found = m_Jobs.find(job);
+	if (found == m_Jobs.end())
+	{
+		return JOB_UNKNOWN;
+	}
+	return found->second->state;
+}
+
+/*
+Returns the result handle of a finished job (a new reference) and frees the job id.
+For a failed job, the error is reported and 0 is returned.  Returns 0 if the job is still pending or running.
+*/
+int PyJob_GetResult(int job)
+{
+	HOLD_GIL
+	AsyncJob *asyncJob = GetJob(job, __FUNCTION__);
+	if (asyncJob == NULL)
+	{
+		return 0;
+	}
+	int state = asyncJob->state;
+	if (state == JOB_PENDING || state == JOB_RUNNING)
+	{
+		agk::PluginError("PyJob_GetResult: The job has not finished.");
+		return 0;
+	}
+	if (asyncJob->interpreter != PyInterp_GetCurrent())
+	{
+		agk::PluginError("PyJob_GetResult: The job belongs to another interpreter.");
+		return 0;
+	}
+	int handle = 0;
+	if (state == JOB_DONE)
+	{
+		handle = GetHandle(asyncJob->result);
+		// The reference now belongs to the handle.
+		asyncJob->result = NULL;
+	}
+	else if (state == JOB_FAILED)
+	{
+		PyErr_Restore(asyncJob->errorType, asyncJob->errorValue, asyncJob->errorTraceback);
+		asyncJob->errorType = asyncJob->errorValue = asyncJob->errorTraceback = NULL;
+		CheckError();
+	}
+	DeleteJob(job, asyncJob);
+	return handle;
+}
+
+/*
+Cancels a job.  A pending job is removed from the queue.  A running job has KeyboardInterrupt raised in it.
+Returns 1 if the job was cancelled or is being cancelled, 0 if it had already finished.
+*/
+int PyJob_Cancel(int job)
+{
+	HOLD_GIL
+	AsyncJob *asyncJob = GetJob(job, __FUNCTION__);
+	if (asyncJob == NULL)
+	{
+		return 0;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_JobMutex);
+		if (asyncJob->state == JOB_PENDING)
+		{
+			for (auto it = m_JobQueue.begin(); it != m_JobQueue.end(); ++it)
+			{
+				if (*it == asyncJob)
+				{
+					m_JobQueue.erase(it);
+					break;
+				}
+			}
+			DeleteJob(job, asyncJob);
+			return 1;
+		}
+		if (asyncJob->state != JOB_RUNNING)
+		{
+			return 0;
+		}
+		asyncJob->cancelRequested = true;
+	}
+	InterruptJob(asyncJob);
+	return 1;
+}
+
+/*
+Module prefetching.  Maps module names to their import job ids.  Finished imports are dropped by the next prefetch
+call because the module is in sys.modules by then.
+*/
+std::map<std::string, int> m_Prefetches;
+
+static void DropImportedPrefetches()
+{
+	for (auto it = m_Prefetches.begin(); it != m_Prefetches.end();)
+	{
+		auto found = m_Jobs.find(it->second);
+		if (found == m_Jobs.end() || found->second->state == JOB_DONE)
+		{
+			if (found != m_Jobs.end())
+			{
+				DeleteJob(found->first, found->second);
+			}
+			it = m_Prefetches.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
+
+/*
+Imports a comma-separated list of modules on the worker thread.
+Modules that are already imported or being prefetched are skipped.  Returns the number of modules queued.
+*/
+int PyImport_Prefetch(const char *names)
+{
+	HOLD_GIL
+	DropImportedPrefetches();
+	PyObject *modules = PyImport_GetModuleDict(); // borrowed ref
+	int queued = 0;
+	std::string list = names;
+	size_t start = 0;
+	while (start <= list.size())
+	{
+		size_t end = list.find(',', start);
+		if (end == std::string::npos)
+		{
+			end = list.size();
+		}
+		size_t first = list.find_first_not_of(" \t", start);
+		size_t last = list.find_last_not_of(" \t", end - 1);
+		start = end + 1;
+		if (first >= end || last < first || last == std::string::npos)
+		{
+			continue;
+		}
+		std::string name = list.substr(first, last - first + 1);
+		if (PyDict_GetItemString(modules, name.c_str()))
+		{
+			continue;
+		}
+		auto found = m_Prefetches.find(name);
+		if (found != m_Prefetches.end())
+		{
+			AsyncJob *job = m_Jobs[found->second];
+			if (job->state == JOB_PENDING || job->state == JOB_RUNNING)
+			{
+				continue;
+			}
+			// Try a failed import again.
+			DeleteJob(found->second, job);
+		}
+		AsyncJob *job = new AsyncJob(JOB_IMPORT);
+		job->text = name;
+		m_Prefetches[name] = QueueJob(job);
+		queued++;
+	}
+	return queued;
+}
+
+/*
+Returns one of: -1 = failed, 0 = not prefetched, 1 = pending, 2 = importing, 3 = imported.
+A module that was imported some other way also returns 3.
+*/
+int PyImport_GetPrefetchState(const char *name)
+{
+	HOLD_GIL
+	DropImportedPrefetches();
+	auto found = m_Prefetches.find(name);
+	if (found != m_Prefetches.end())
+	{
+		return m_Jobs[found->second]->state;
+	}
+	return (PyDict_GetItemString(PyImport_GetModuleDict(), name)) ? JOB_DONE : JOB_UNKNOWN;
+}
+
+/*
+Returns the error message of a failed prefetch, or an empty string.
+*/
+char *PyImport_GetPrefetchError(const char *name)
+{
+	HOLD_GIL
+	DropImportedPrefetches();
+	auto found = m_Prefetches.find(name);
+	if (found == m_Prefetches.end())
+	{
+		return CreateString("");
+	}
+	AsyncJob *job = m_Jobs[found->second];
+	if (job->state != JOB_FAILED || job->errorValue == NULL)
+	{
+		return CreateString("");
+	}
+	ScopedInterpreter scope(job->interpreter);
+	PyObject *text = PyObject_Str(job->errorValue);
+	char *result = (text) ? CreateString(text) : CreateString("");
+	Py_XDECREF(text);
+	PyErr_Clear();
+	return result;
+}
+
+void ShutdownAsyncJobs()
+{
+	if (m_JobWorker.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_JobMutex);
+			m_StopJobWorker = true;
+			m_JobQueue.clear();
+			for (auto &entry : m_Jobs)
+			{
+				entry.second->cancelRequested = true;
+			}
+		}
+		m_JobAvailable.notify_one();
+		{
+			HOLD_GIL
+			for (auto &entry : m_Jobs)
+			{
+				if (entry.second->state == JOB_RUNNING)
+				{
+					InterruptJob(entry.second);
+				}
+			}
+		}
+		m_JobWorker.join();
+	}
+	HOLD_GIL
+	while (!m_Jobs.empty())
+	{
+		DeleteJob(m_Jobs.begin()->first, m_Jobs.begin()->second);
+	}
+	m_Prefetches.clear();
+	m_NextJobID = 1;
+}
+
+bool ReleaseInterpreterJobs(int id)
+{
+	std::vector<AsyncJob *> running;
+	{
+		std::lock_guard<std::mutex> lock(m_JobMutex);
+		m_JobQueue.erase(std::remove_if(m_JobQueue.begin(), m_JobQueue.end(), [id](AsyncJob *job) {
+			if (job->interpreter != id)
+			{
+				return false;
+			}
+			job->state = JOB_CANCELLED;
+			return true;
+		}), m_JobQueue.end());
+		for (auto &entry : m_Jobs)
+		{
+			if (entry.second->interpreter == id && entry.second->state == JOB_RUNNING)
+			{
+				entry.second->cancelRequested = true;
+				running.push_back(entry.second);
+			}
+		}
+	}
+	// The interpreter's thread state is current, so the job's thread can be found without switching.
+	for (AsyncJob *job : running)
+	{
+		if (unsigned long threadId = job->threadId)
+		{
+			PyThreadState_SetAsyncExc(threadId, PyExc_KeyboardInterrupt);
+		}
+	}
+	// The worker needs the GIL to finish the job.  A job blocked outside of Python code doesn't see the interrupt, so
+	// only wait so long.  Ending the interpreter while its job still has a thread state would abort the process.
+	bool stopped = true;
+	Py_BEGIN_ALLOW_THREADS
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(JOB_STOP_TIMEOUT_MS);
+	for (AsyncJob *job : running)
+	{
+		while (job->state == JOB_RUNNING && std::chrono::steady_clock::now() < deadline)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		stopped = stopped && job->state != JOB_RUNNING;
+	}
+	Py_END_ALLOW_THREADS
+	if (!stopped)
+	{
+		agk::PluginError("PyInterp_Destroy: A job running in the interpreter did not stop.  The interpreter was not destroyed.");
+		return false;
+	}
+	for (auto it = m_Jobs.begin(); it != m_Jobs.end();)
+	{
+		if (it->second->interpreter != id)
+		{
+			++it;
+			continue;
+		}
+		it->second->Release();
+		delete it->second;
+		it = m_Jobs.erase(it);
+	}
+	for (auto it = m_Prefetches.begin(); it != m_Prefetches.end();)
+	{
+		it = (m_Jobs.count(it->second)) ? std::next(it) : m_Prefetches.erase(it);
+	}	return true;
+}
@@ -0,0 +1,232 @@
+/*
+Copyright (c) 2017 Adam Biser <adambiser@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+asyncio loop pumping.
+
+The plugin keeps one asyncio event loop, which is also set as the current event loop, so asyncio.get_event_loop()
+returns it.  Call PyAsync_Pump once per frame to run its ready callbacks, due timers and I/O for up to a given
+number of milliseconds.  Pumping stops early once the loop is idle.
+
+The loop's selector never blocks, so a pump never waits on I/O or for a timer to come due.  Those are picked up by
+the next frame's pump instead.
+
+Each interpreter gets its own loop.  PyAsync_Pump runs the loops of every interpreter, each in its own interpreter.
+The other functions use the active interpreter's loop.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <vector>
+
+#include "PythonPlugin.h"
+#include "PythonErrorHandling.h"
+#include "PythonThreading.h"
+#include "PluginHelpers.h"
+#ifdef PLUGIN
+#include "..\AGKLibraryCommands.h"
+#endif
+
+static const char *PUMP_SCRIPT = R"(import asyncio, selectors, threading
+from asyncio import events
+
+
+class PumpSelector(selectors.DefaultSelector):
+    def select(self, timeout=None):
+        return super().select(0)
+
+
+loop = None
+
+
+def get_loop():
+    global loop
+    if loop is None or loop.is_closed():
+        loop = asyncio.SelectorEventLoop(PumpSelector())
+        asyncio.set_event_loop(loop)
+    return loop
+
+
+def pump(budget):
+    loop = get_loop()
+    deadline = loop.time() + budget
+    # Look like run_forever to the code being run.
+    loop._thread_id = threading.get_ident()
+    events._set_running_loop(loop)
+    iterations = 0
+    try:
+        while True:
+            loop._run_once()
+            iterations += 1
+            loop._stopping = False
+            now = loop.time()
+            if now >= deadline:
+                break
+            if not loop._ready and not (loop._scheduled and loop._scheduled[0]._when <= now):
+                break
+    finally:
+        events._set_running_loop(None)
+        loop._thread_id = None
+    return iterations
+
+
+def task_count():
+    if loop is None:
+        return 0
+    all_tasks = getattr(asyncio, 'all_tasks', None) or asyncio.Task.all_tasks
+    return sum(1 for task in all_tasks(loop) if not task.done())
+
+
+def close():
+    global loop
+    if loop is not None and not loop.is_closed():
+        loop.close()
+        asyncio.set_event_loop(None)
+    loop = None
+)";
+
+// Interpreter id -> pump module.
+std::map<int, PyObject *> m_PumpModules;
+
+static PyObject *CallModuleFunction(PyObject *module, const char *name, PyObject *args)
+{
+	PyObject *function = PyObject_GetAttrString(module, name);
+	if (function == NULL)
+	{
+		return NULL;
+	}
+	PyObject *result = PyObject_CallObject(function, args);
+	Py_DECREF(function);
+	return result;
+}
+
+// Calls a function of the active interpreter's pump module, creating the module if needed.
+static PyObject *CallPumpFunction(const char *name, PyObject *args)
+{
+	PyObject *&module = m_PumpModules[PyInterp_GetCurrent()];
+	if (module == NULL)
+	{
+		module = PyModule_New("agk_asyncio_pump");
+		PyObject *dict = PyModule_GetDict(module); // borrowed ref
+		PyDict_SetItemString(dict, "__builtins__", PyEval_GetBuiltins());
+		PyObject *result = PyRun_String(PUMP_SCRIPT, Py_file_input, dict, dict);
+		if (result == NULL)
+		{
+			m_PumpModules.erase(PyInterp_GetCurrent());
+			Py_DECREF(module);
+			return NULL;
+		}
+		Py_DECREF(result);
+	}
+	return CallModuleFunction(module, name, args);
+}
+
+/*
+Returns the plugin's event loop, creating it if needed.
+Borrowed ref.
+*/
+int PyAsync_GetLoop()
+{
+	HOLD_GIL
+	PyObject *loop = CallPumpFunction("get_loop", NULL);
+	CheckError();
+	Py_XDECREF(loop); // The pump module keeps a reference.
+	return GetHandle(loop);
+}
+
+/*
+Runs the event loops for up to budgetMS milliseconds in total, or until they are idle.
+Returns the number of loop iterations that ran.
+*/
+int PyAsync_Pump(float budgetMS)
+{
+	HOLD_GIL
+	// Pumping starts the active interpreter's loop if it doesn't have one yet.
+	m_PumpModules.insert(std::make_pair(PyInterp_GetCurrent(), (PyObject *)NULL));
+	auto start = std::chrono::steady_clock::now();
+	int iterations = 0;
+	// Copy the ids because CallPumpFunction drops a module that fails to load.
+	std::vector<int> interpreters;
+	for (auto &entry : m_PumpModules)
+	{
+		interpreters.push_back(entry.first);
+	}
+	for (int id : interpreters)
+	{
+		// Every loop runs at least once per pump, even when the earlier ones used up the budget.
+		double remaining = budgetMS - std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		ScopedInterpreter scope(id);
+		PyObject *args = Py_BuildValue("(d)", std::max(0.0, remaining) / 1000.0);
+		PyObject *result = (args) ? CallPumpFunction("pump", args) : NULL;
+		Py_XDECREF(args);
+		iterations += (result) ? (int)PyLong_AsLong(result) : 0;
+		Py_XDECREF(result);
+		CheckError();
+	}
+	return iterations;
+}
+
+/*
+Returns the number of the loop's tasks that have not finished.
+*/
+int PyAsync_GetTaskCount()
+{
+	HOLD_GIL
+	PyObject *result = CallPumpFunction("task_count", NULL);
+	int count = (result) ? (int)PyLong_AsLong(result) : 0;
+	Py_XDECREF(result);
+	CheckError();
+	return count;
+}
+
+// Closes an interpreter's loop and releases its pump module.  Requires that interpreter's thread state.
+static void ClosePumpModule(int id)
+{
+	auto found = m_PumpModules.find(id);
+	if (found == m_PumpModules.end())
+	{
+		return;
+	}
+	if (found->second)
+	{
+		PyObject *result = CallModuleFunction(found->second, "close", NULL);
+		Py_XDECREF(result);
+		CheckError();
+		Py_DECREF(found->second);
+	}
+	m_PumpModules.erase(found);
+}
+
+/*
+Closes the active interpreter's event loop.  The next pump starts a new one.
+*/
+void PyAsync_Close()
+{
+	HOLD_GIL
+	ClosePumpModule(PyInterp_GetCurrent());
+}
+
+void ReleaseInterpreterLoop(int id)
+{
+	ClosePumpModule(id);
+}
@@ -0,0 +1,159 @@
+/*
+Copyright (c) 2017 Adam Biser <adambiser@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+Priority-ordered registry of timed Python calls, used by the scheduler and frame hooks.  See CallRegistry.h.
+*/
+
+#include <algorithm>
+
+#include "CallRegistry.h"
+#include "PythonPlugin.h"
+#include "PythonErrorHandling.h"
+#ifdef PLUGIN
+#include "..\AGKLibraryCommands.h"
+#endif
+
+CallRegistry::CallRegistry(const char *kind)
+	: m_Kind(kind)
+	, m_NextID(1)
+{
+}
+
+int CallRegistry::Add(CallEntry *entry, int priority)
+{
+	entry->id = m_NextID++;
+	entry->priority = priority;
+	entry->interpreter = PyInterp_GetCurrent();
+	auto position = std::upper_bound(m_Entries.begin(), m_Entries.end(), priority,
+		[](int priority, const CallEntry *other) { return priority > other->priority; });
+	m_Entries.insert(position, entry);
+	m_IDs[entry->id] = entry;
+	return entry->id;
+}
+
+CallEntry *CallRegistry::Get(int id, const char *caller) const
+{
+	CallEntry *entry = Find(id);
+	if (entry == NULL)
+	{
+		std::string msg = caller;
+		msg += ": Invalid " + m_Kind + " id.";
+		agk::PluginError(msg.c_str());
+	}
+	return entry;
+}
+
+CallEntry *CallRegistry::Find(int id) const
+{
+	auto found = m_IDs.find(id);
+	return (found == m_IDs.end()) ? NULL : found->second;
+}
+
+void CallRegistry::Remove(int id)
+{
+	auto found = m_IDs.find(id);
+	if (found == m_IDs.end())
+	{
+		return;
+	}
+	CallEntry *entry = found->second;
+	m_IDs.erase(found);
+	entry->removed = true;
+	ScopedInterpreter scope(entry->interpreter);
+	entry->ReleaseObjects();
+}
+
+void CallRegistry::Clear()
+{
+	for (CallEntry *entry : m_Entries)
+	{
+		if (!entry->removed)
+		{
+			ScopedInterpreter scope(entry->interpreter);
+			entry->ReleaseObjects();
+		}
+		delete entry;
+	}
+	m_Entries.clear();
+	m_IDs.clear();
+}
+
+void CallRegistry::ReleaseInterpreter(int id)
+{
+	m_Entries.erase(std::remove_if(m_Entries.begin(), m_Entries.end(), [this, id](CallEntry *entry) {
+		if (entry->interpreter != id)
+		{
+			return false;
+		}
+		if (!entry->removed)
+		{
+			entry->ReleaseObjects();
+			m_IDs.erase(entry->id);
+		}
+		delete entry;
+		return true;
+	}), m_Entries.end());
+}
+
+int CallRegistry::Run(const EntryFunction &ready, const EntryFunction &run, const std::function<bool(CallClock::time_point now)> &keepGoing)
+{
+	// Drop removed entries.
+	m_Entries.erase(std::remove_if(m_Entries.begin(), m_Entries.end(), [](CallEntry *entry) {
+		if (!entry->removed)
+		{
+			return false;
+		}
+		delete entry;
+		return true;
+	}), m_Entries.end());
+	CallClock::time_point now = CallClock::now();
+	int count = 0;
+	// Indexed because an entry can add others while it runs.
+	for (size_t index = 0; index < m_Entries.size(); index++)
+	{
+		CallEntry *entry = m_Entries[index];
+		if (entry->removed || !ready(entry, now))
+		{
+			continue;
+		}
+		ScopedInterpreter scope(entry->interpreter);
+		bool succeeded = run(entry, now);
+		CallClock::time_point end = CallClock::now();
+		entry->lastTime = std::chrono::duration<double>(end - now).count();
+		entry->totalTime += entry->lastTime;
+		entry->calls++;
+		now = end;
+		count++;
+		if (!succeeded)
+		{
+			CheckError();
+			// Don't charge the error report to the next entry.
+			now = CallClock::now();
+		}
+		if (!keepGoing(now))
+		{
+			break;
+		}
+	}
+	return count;
+}
@@ -0,0 +1,90 @@
+/*
+Copyright (c) 2017 Adam Biser <adambiser@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef CALL_REGISTRY_H_
+#define CALL_REGISTRY_H_
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "PluginHelpers.h"
+
+/*
+Bookkeeping shared by the scheduler (Scheduler.cpp) and frame hooks (FrameHooks.cpp).
+
+Entries are kept in descending priority order, then in the order they were added, and looked up by id.  Each one
+is run in the interpreter that was active when it was added and every run is timed.  Defined in CallRegistry.cpp.
+*/
+typedef std::chrono::steady_clock CallClock;
+
+struct CallEntry
+{
+	int id;
+	int priority;
+	int interpreter;
+	bool removed;
+	// Timing in seconds.
+	double lastTime;
+	double totalTime;
+	int calls;
+
+	virtual ~CallEntry() {}
+	// Releases the entry's Python references.  Called with the GIL held and the entry's interpreter active.
+	virtual void ReleaseObjects() = 0;
+};
+
+class CallRegistry
+{
+public:
+	typedef std::function<bool(CallEntry *entry, CallClock::time_point now)> EntryFunction;
+
+	// kind names the entries in error messages, e.g. "hook".
+	explicit CallRegistry(const char *kind);
+	// Takes ownership of a new entry, gives it an id and adds it to the current interpreter.  Returns the id.
+	int Add(CallEntry *entry, int priority);
+	// Reports an error and returns NULL for unknown ids.
+	CallEntry *Get(int id, const char *caller) const;
+	// Returns NULL for unknown ids.
+	CallEntry *Find(int id) const;
+	// Releases the entry's references.  The entry itself is deleted by the next Run.
+	void Remove(int id);
+	void Clear();
+	// Drops the entries of an interpreter that is being destroyed.
+	void ReleaseInterpreter(int id);
+	/*
+	Calls run for each entry that ready accepts, in priority order.  run returns false when the call failed, and its
+	error is then reported with CheckError.  Stops early once keepGoing returns false.  Returns the number of entries
+	run.
+	*/
+	int Run(const EntryFunction &ready, const EntryFunction &run, const std::function<bool(CallClock::time_point now)> &keepGoing);
+	const std::map<int, CallEntry *> &GetEntries() const { return m_IDs; }
+private:
+	std::string m_Kind;
+	std::vector<CallEntry *> m_Entries;
+	std::map<int, CallEntry *> m_IDs;
+	int m_NextID;
+};
+
+#endif // CALL_REGISTRY_H_
@@ -0,0 +1,369 @@
+/*
+Copyright (c) 2017 Adam Biser <adambiser@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+Command buffers.
+
+Each exported function costs an AGK to DLL transition plus handle validation.  A command buffer lets AGK script
+record many operations into a memblock and run all of them with a single ExecuteCommandBuffer call.
+
+All values are 32-bit little-endian.  A buffer is a sequence of operations:
+	int opcode, followed by the operands for that opcode.
+
+Each operand is a tag followed by its payload:
+	OPERAND_HANDLE	int handle
+	OPERAND_INT		int value
+	OPERAND_FLOAT	float value
+	OPERAND_STRING	int byte length, then the UTF-8 bytes (no terminator)
+	OPERAND_RESULT	int index of an earlier operation in the same buffer whose result object is used
+
+Opcodes and their operands:
+	OP_SETITEM	object, key, value		Result: 0 or -1
+	OP_CALL		callable, int argc, argc argument operands	Result: new object handle
+	OP_APPEND	list, item				Result: 0 or -1
+	OP_GETATTR	object, name			Result: new object handle
+
+The result memblock receives one int per executed operation.  Object handles returned there are new references
+that the caller must DECREF, the same as with PyObject_Call and PyObject_GetAttr.
+*/
+
+#include <string.h>
+#include <vector>
+
+#include "PythonPlugin.h"
+#include "PythonErrorHandling.h"
+#include "PluginHelpers.h"
+#include "PythonThreading.h"
+#ifdef PLUGIN
+#include "..\AGKLibraryCommands.h"
+#endif
+
+enum CommandOpcode
+{
+	OP_SETITEM = 1,
+	OP_CALL = 2,
+	OP_APPEND = 3,
+	OP_GETATTR = 4,
+};
+
+enum CommandOperand
+{
+	OPERAND_HANDLE = 0,
+	OPERAND_INT = 1,
+	OPERAND_FLOAT = 2,
+	OPERAND_STRING = 3,
+	OPERAND_RESULT = 4,
+};
+
+class CommandReader
+{
+public:
+	CommandReader(const unsigned char *buffer, int size, const std::vector<PyObject *> &results)
+		: m_Buffer(buffer), m_Size(size), m_Position(0), m_Results(results), m_Error(NULL)
+	{
+	}
+	bool AtEnd() const
+	{
+		return m_Position >= m_Size;
+	}
+	const char *GetError() const
+	{
+		return m_Error;
+	}
+	bool ReadInt(int &value)
+	{
+		if (m_Position + (int)sizeof(int) > m_Size)
+		{
+			m_Error = "Unexpected end of command buffer.";
+			return false;
+		}
+		memcpy(&value, m_Buffer + m_Position, sizeof(int));
+		m_Position += sizeof(int);
+		return true;
+	}
+	// Reads the operand count that precedes count operands.  Every operand takes at least two ints.
+	bool ReadCount(int &count)
+	{
+		if (!ReadInt(count))
+		{
+			return false;
+		}
+		if (count < 0 || count > (m_Size - m_Position) / (2 * (int)sizeof(int)))
+		{
+			m_Error = "Operand count runs past the end of the command buffer.";
+			return false;
+		}
+		return true;
+	}
+	// Returns a new reference to the operand value or NULL.
+	PyObject *ReadOperand()
+	{
+		int tag;
+		if (!ReadInt(tag))
+		{
+			return NULL;
+		}
+		switch (tag)
+		{
+		case OPERAND_HANDLE:
+		{
+			int handle;
+			if (!ReadInt(handle))
+			{
+				return NULL;
+			}
+			PyObject *object = GetPyObject(handle);
+			if (object == NULL)
+			{
+				m_Error = "Invalid handle operand.";
+				return NULL;
+			}
+			Py_INCREF(object);
+			return object;
+		}
+		case OPERAND_INT:
+		{
+			int value;
+			if (!ReadInt(value))
+			{
+				return NULL;
+			}
+			return PyLong_FromLong(value);
+		}
+		case OPERAND_FLOAT:
+		{
+			int bits;
+			if (!ReadInt(bits))
+			{
+				return NULL;
+			}
+			float value;
+			memcpy(&value, &bits, sizeof(float));
+			return PyFloat_FromDouble(value);
+		}
+		case OPERAND_STRING:
+		{
+			int length;
+			if (!ReadInt(length))
+			{
+				return NULL;
+			}
+			if (length < 0 || length > m_Size - m_Position)
+			{
+				m_Error = "String operand runs past the end of the command buffer.";
+				return NULL;
+			}
+			PyObject *text = PyUnicode_FromStringAndSize((const char *)m_Buffer + m_Position, length);
+			m_Position += length;
+			return text;
+		}
+		case OPERAND_RESULT:
+		{
+			int index;
+			if (!ReadInt(index))
+			{
+				return NULL;
+			}
+			if (index < 0 || index >= (int)m_Results.size() || m_Results[index] == NULL)
+			{
+				m_Error = "Result operand does not refer to an earlier object result.";
+				return NULL;
+			}
+			Py_INCREF(m_Results[index]);
+			return m_Results[index];
+		}
+		}
+		m_Error = "Unknown operand tag.";
+		return NULL;
+	}
+private:
+	const unsigned char *m_Buffer;
+	int m_Size;
+	int m_Position;
+	const std::vector<PyObject *> &m_Results;
+	const char *m_Error;
+};
+
+/*
+Runs a single operation.  Returns a new reference for object results, Py_None for status results, or NULL on error.
+*/
+static PyObject *RunCommand(int opcode, CommandReader &reader)
+{
+	switch (opcode)
+	{
+	case OP_SETITEM:
+	{
+		PyObject *object = reader.ReadOperand();
+		PyObject *key = (object) ? reader.ReadOperand() : NULL;
+		PyObject *value = (key) ? reader.ReadOperand() : NULL;
+		int status = -1;
+		if (value)
+		{
+			status = (PyDict_CheckExact(object)) ? PyDict_SetItem(object, key, value) : PyObject_SetItem(object, key, value);
+		}
+		Py_XDECREF(value);
+		Py_XDECREF(key);
+		Py_XDECREF(object);
+		if (status == -1)
+		{
+			return NULL;
+		}
+		Py_RETURN_NONE;
+	}
+	case OP_CALL:
+	{
+		PyObject *callable = reader.ReadOperand();
+		int argc;
+		if (callable == NULL || !reader.ReadCount(argc))
+		{
+			Py_XDECREF(callable);
+			return NULL;
+		}
+		PyObject *args = PyTuple_New(argc);
+		if (args == NULL)
+		{
+			Py_DECREF(callable);
+			return NULL;
+		}
+		for (int index = 0; index < argc; index++)
+		{
+			PyObject *arg = reader.ReadOperand();
+			if (arg == NULL)
+			{
+				Py_DECREF(args);
+				Py_DECREF(callable);
+				return NULL;
+			}
+			// PyTuple_SET_ITEM steals the reference.
+			PyTuple_SET_ITEM(args, index, arg);
+		}
+		PyObject *result = PyObject_Call(callable, args, NULL);
+		Py_DECREF(args);
+		Py_DECREF(callable);
+		return result;
+	}
+	case OP_APPEND:
+	{
+		PyObject *list = reader.ReadOperand();
+		PyObject *item = (list) ? reader.ReadOperand() : NULL;
+		int status = -1;
+		if (item)
+		{
+			status = PyList_Append(list, item);
+		}
+		Py_XDECREF(item);
+		Py_XDECREF(list);
+		if (status == -1)
+		{
+			return NULL;
+		}
+		Py_RETURN_NONE;
+	}
+	case OP_GETATTR:
+	{
+		PyObject *object = reader.ReadOperand();
+		PyObject *name = (object) ? reader.ReadOperand() : NULL;
+		PyObject *result = (name) ? PyObject_GetAttr(object, name) : NULL;
+		Py_XDECREF(name);
+		Py_XDECREF(object);
+		return result;
+	}
+	}
+	return NULL;
+}
+
+/*
+Runs the first size bytes of the command memblock, or the whole memblock when size is 0.
+Returns the number of operations executed or -1 on error.  Execution stops at the first failing operation.
+*/
+int ExecuteCommandBuffer(int memID, int size, int resultMemID)
+{
+	HOLD_GIL
+	if (size == 0 && agk::GetMemblockExists(memID))
+	{
+		size = agk::GetMemblockSize(memID);
+	}
+	const unsigned char *buffer = GetMemblockRange(memID, 0, size);
+	if (buffer == NULL)
+	{
+		return -1;
+	}
+	int resultSize = agk::GetMemblockExists(resultMemID) ? agk::GetMemblockSize(resultMemID) : 0;
+	unsigned char *resultBuffer = GetMemblockRange(resultMemID, 0, resultSize);
+	if (resultBuffer == NULL)
+	{
+		return -1;
+	}
+	// Object results are kept here so that later operations can refer to them without going through handles.
+	std::vector<PyObject *> results;
+	CommandReader reader(buffer, size, results);
+	while (!reader.AtEnd())
+	{
+		if ((int)((results.size() + 1) * sizeof(int)) > resultSize)
+		{
+			agk::PluginError("ExecuteCommandBuffer: Result memblock is too small.");
+			return -1;
+		}
+		int opcode;
+		PyObject *result = NULL;
+		if (reader.ReadInt(opcode))
+		{
+			result = RunCommand(opcode, reader);
+		}
+		if (result == NULL)
+		{
+			std::string msg = "ExecuteCommandBuffer: Operation ";
+			msg += std::to_string(results.size());
+			msg += " failed.";
+			if (reader.GetError())
+			{
+				msg += "  ";
+				msg += reader.GetError();
+			}
+			else if (!PyErr_Occurred())
+			{
+				msg += "  Unknown opcode.";
+			}
+			int status = -1;
+			memcpy(resultBuffer + results.size() * sizeof(int), &status, sizeof(int));
+			CheckError();
+			agk::PluginError(msg.c_str());
+			return -1;
+		}
+		int value;
+		if (result == Py_None && opcode != OP_CALL && opcode != OP_GETATTR)
+		{
+			// Status result.
+			Py_DECREF(result);
+			result = NULL;
+			value = 0;
+		}
+		else
+		{
+			// The new reference is handed to the caller through the handle.
+			value = GetHandle(result);
+		}
+		memcpy(resultBuffer + results.size() * sizeof(int), &value, sizeof(int));
+		results.push_back(result);
+	}
+	return (int)results.size();
+}
@@ -0,0 +1,221 @@
+/*
+Copyright (c) 2017 Adam Biser <adambiser@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+Frame hooks.
+
+Register Python callables once with PyHook_Add, then call PyHook_Fire(dt) once per frame to call all of them in
+priority order, highest first.  Hooks added with passDeltaTime = 1 are called as hook(dt), the others as hook().
+
+All hooks share one cached argument tuple.  Its float is updated in place when nothing else holds a reference to
+it, so a frame where every hook returns None doesn't allocate anything.
+
+A hook that raises an error is reported, marked as failed and not called again.
+
+Each hook is called in the interpreter that was active when it was added.  The cached tuples only hold a float, whose
+type is shared by every interpreter, so hooks in all interpreters can use them.
+*/
+
+#include <chrono>
+
+#include "CallRegistry.h"
+#include "PythonPlugin.h"
+#include "PythonErrorHandling.h"
+#include "PythonThreading.h"
+#include "PluginHelpers.h"
+#ifdef PLUGIN
+#include "..\AGKLibraryCommands.h"
+#endif
+
+enum HookState
+{
+	HOOK_FAILED = -1,
+	HOOK_UNKNOWN = 0,
+	HOOK_ACTIVE = 1,
+};
+
+struct FrameHook : CallEntry
+{
+	bool passDeltaTime;
+	PyObject *callable;
+	HookState state;
+
+	void ReleaseObjects() override
+	{
+		Py_CLEAR(callable);
+	}
+};
+
+CallRegistry m_Hooks("hook");
+// (dt,) and (), reused every frame.
+PyObject *m_HookArgs = NULL;
+PyObject *m_HookNoArgs = NULL;
+double m_HookFireTime = 0;
+
+static FrameHook *GetHook(int id, const char *caller)
+{
+	return static_cast<FrameHook *>(m_Hooks.Get(id, caller));
+}
+
+/*
+Returns the cached (dt,) tuple with dt set.  Only allocates when a hook kept a reference to the tuple or its float.
+*/
+static PyObject *GetDeltaTimeArgs(float deltaTime)
+{
+	if (m_HookArgs != NULL && Py_REFCNT(m_HookArgs) == 1)
+	{
+		PyObject *value = PyTuple_GET_ITEM(m_HookArgs, 0);
+		if (Py_REFCNT(value) == 1)
+		{
+			// Nothing else can see this float, so it is safe to change.
+			((PyFloatObject *)value)->ob_fval = deltaTime;
+			return m_HookArgs;
+		}
+		PyObject *newValue = PyFloat_FromDouble(deltaTime);
+		if (newValue == NULL)
+		{
+			return NULL;
+		}
+		PyTuple_SET_ITEM(m_HookArgs, 0, newValue);
+		Py_DECREF(value);
+		return m_HookArgs;
+	}
+	Py_XDECREF(m_HookArgs);
+	m_HookArgs = Py_BuildValue("(d)", (double)deltaTime);
+	return m_HookArgs;
+}
+
+/*
+Adds a frame hook.  The registry keeps its own reference to the callable.
+Higher priority hooks are called first.  Returns the hook id.
+*/
+int PyHook_Add(int hcallable, int priority, int passDeltaTime)
+{
+	HOLD_GIL
+	REQUIRED_HANDLE(hcallable)
+	PyObject *callable = GetPyObject(hcallable);
+	if (!PyCallable_Check(callable))
+	{
+		agk::PluginError("PyHook_Add: The object is not callable.");
+		return 0;
+	}
+	FrameHook *hook = new FrameHook();
+	hook->passDeltaTime = passDeltaTime != 0;
+	hook->callable = callable;
+	Py_INCREF(callable);
+	hook->state = HOOK_ACTIVE;
+	return m_Hooks.Add(hook, priority);
+}
+
+/*
+Removes a hook and releases the registry's reference to its callable.
+*/
+void PyHook_Remove(int id)
+{
+	HOLD_GIL
+	if (GetHook(id, __FUNCTION__))
+	{
+		m_Hooks.Remove(id);
+	}
+}
+
+void PyHook_Clear()
+{
+	HOLD_GIL
+	m_Hooks.Clear();
+	Py_CLEAR(m_HookArgs);
+	Py_CLEAR(m_HookNoArgs);
+}
+
+void ReleaseInterpreterHooks(int id)
+{
+	m_Hooks.ReleaseInterpreter(id);
+}
+
+/*
+Calls every active hook once, in priority order.  Returns the number of hooks called.
+Hooks that raise an error are marked as failed and their error is reported.
+*/
+int PyHook_Fire(float deltaTime)
+{
+	HOLD_GIL
+	if (m_HookNoArgs == NULL)
+	{
+		m_HookNoArgs = PyTuple_New(0);
+	}
+	CallClock::time_point start = CallClock::now();
+	int called = m_Hooks.Run(
+		[](CallEntry *entry, CallClock::time_point) {
+			return static_cast<FrameHook *>(entry)->state == HOOK_ACTIVE;
+		},
+		[deltaTime](CallEntry *entry, CallClock::time_point) {
+			FrameHook *hook = static_cast<FrameHook *>(entry);
+			PyObject *args = (hook->passDeltaTime) ? GetDeltaTimeArgs(deltaTime) : m_HookNoArgs;
+			PyObject *result = (args) ? PyObject_Call(hook->callable, args, NULL) : NULL;
+			if (result == NULL)
+			{
+				hook->state = HOOK_FAILED;
+				return false;
+			}
+			Py_DECREF(result);
+			return true;
+		},
+		[](CallClock::time_point) { return true; });
+	m_HookFireTime = std::chrono::duration<double>(CallClock::now() - start).count();
+	return called;
+}
+
+/*
+Returns one of: -1 = failed, 0 = unknown hook, 1 = active.
+*/
+int PyHook_GetState(int id)
+{
+	FrameHook *hook = static_cast<FrameHook *>(m_Hooks.Find(id));
+	return (hook) ? hook->state : HOOK_UNKNOWN;
+}
+
+/*
+Per-hook timing, in milliseconds.
+*/
+float PyHook_GetLastTime(int id)
+{
+	FrameHook *hook = GetHook(id, __FUNCTION__);
+	return (hook) ? (float)(hook->lastTime * 1000.0) : 0.0f;
+}
+
+float PyHook_GetTotalTime(int id)
+{
+	FrameHook *hook = GetHook(id, __FUNCTION__);
+	return (hook) ? (float)(hook->totalTime * 1000.0) : 0.0f;
+}
+
+int PyHook_GetCallCount(int id)
+{
+	FrameHook *hook = GetHook(id, __FUNCTION__);
+	return (hook) ? hook->calls : 0;
+}
+
+// How long the last PyHook_Fire took in total, in milliseconds.
+float PyHook_GetFireTime()
+{
+	return (float)(m_HookFireTime * 1000.0);
+}
@@ -0,0 +1,255 @@
+/*
+Copyright (c) 2017 Adam Biser <adambiser@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+Input snapshots for the agk module.
+
+CaptureInput gathers the keyboard, mouse, touch and joystick state into one struct and returns a read-only
+memoryview of it, so Python handles a frame's input with one call instead of one per key:
+
+	snapshot = agk.CaptureInput()
+	header = struct.unpack_from(agk.INPUT_SNAPSHOT_FORMAT, snapshot)
+	keys = header[8]								# Bitset, one bit per key code.
+	if keys[32 >> 3] & (1 << (32 & 7)):				# Space is down.
+		...
+	for touch in struct.iter_unpack(agk.INPUT_TOUCH_FORMAT,
+			snapshot[agk.INPUT_TOUCHES_OFFSET:agk.INPUT_TOUCHES_OFFSET + header[11] * agk.INPUT_TOUCH_SIZE]):
+		...
+
+AGK scripts can capture with PyInput_Capture before running Python, which then reads it with GetInputSnapshot.
+Every view shares the same memory, so views see the newest capture.
+
+Layout, little-endian:
+
+	Header, INPUT_SNAPSHOT_FORMAT
+		frame							Increases by one per capture.
+		mouseX, mouseY, mouseWheel, mouseWheelDelta
+		mouseButtons, mousePressed, mouseReleased	Bit 0 = left, 1 = right, 2 = middle.
+		keys, keysPressed, keysReleased				32-byte bitsets indexed by key code.
+		touchCount
+	INPUT_MAX_TOUCHES touches at INPUT_TOUCHES_OFFSET, INPUT_TOUCH_FORMAT
+		id, type, x, y, startX, startY, time, released
+	INPUT_MAX_JOYSTICKS joysticks at INPUT_JOYSTICKS_OFFSET, INPUT_JOYSTICK_FORMAT, for raw joysticks 1 and up
+		exists, x, y, z, rx, ry, rz, buttons, pressed, released		Button bits start with button 1 at bit 0.
+*/
+
+#include <cstddef>
+#include <cstring>
+
+#include "AgkModule.h"
+#include "PythonPlugin.h"
+#include "PythonThreading.h"
+#include "PluginHelpers.h"
+#ifdef PLUGIN
+#include "..\AGKLibraryCommands.h"
+#endif
+
+#define INPUT_KEY_COUNT			256
+#define INPUT_MAX_TOUCHES		16
+#define INPUT_MAX_JOYSTICKS		8
+#define INPUT_JOYSTICK_BUTTONS	32
+
+#define INPUT_SNAPSHOT_FORMAT	"<I4f3I32s32s32si"
+#define INPUT_TOUCH_FORMAT		"<Ii5fi"
+#define INPUT_JOYSTICK_FORMAT	"<i6f3I"
+
+struct InputTouch
+{
+	unsigned int id;
+	int type;
+	float x, y;
+	float startX, startY;
+	float time;
+	int released;
+};
+
+struct InputJoystick
+{
+	int exists;
+	float x, y, z;
+	float rx, ry, rz;
+	unsigned int buttons, pressed, released;
+};
+
+struct InputSnapshot
+{
+	unsigned int frame;
+	float mouseX, mouseY;
+	float mouseWheel, mouseWheelDelta;
+	unsigned int mouseButtons, mousePressed, mouseReleased;
+	unsigned char keys[INPUT_KEY_COUNT / 8];
+	unsigned char keysPressed[INPUT_KEY_COUNT / 8];
+	unsigned char keysReleased[INPUT_KEY_COUNT / 8];
+	int touchCount;
+	InputTouch touches[INPUT_MAX_TOUCHES];
+	InputJoystick joysticks[INPUT_MAX_JOYSTICKS];
+};
+
+// Keep in step with the format strings.
+static_assert(sizeof(InputTouch) == 32, "InputTouch does not match INPUT_TOUCH_FORMAT.");
+static_assert(sizeof(InputJoystick) == 40, "InputJoystick does not match INPUT_JOYSTICK_FORMAT.");
+static_assert(offsetof(InputSnapshot, touches) == 132, "InputSnapshot does not match INPUT_SNAPSHOT_FORMAT.");
+
+InputSnapshot m_InputSnapshot;
+
+static inline unsigned int MouseBits(int left, int right, int middle)
+{
+	return (left ? 1 : 0) | (right ? 2 : 0) | (middle ? 4 : 0);
+}
+
+/*
+Fills the snapshot from AGK.  Only call from the AGK main thread.
+*/
+static void CaptureInputSnapshot()
+{
+	InputSnapshot &snapshot = m_InputSnapshot;
+	snapshot.frame++;
+	snapshot.mouseX = agk::GetRawMouseX();
+	snapshot.mouseY = agk::GetRawMouseY();
+	snapshot.mouseWheel = agk::GetRawMouseWheel();
+	snapshot.mouseWheelDelta = agk::GetRawMouseWheelDelta();
+	snapshot.mouseButtons = MouseBits(agk::GetRawMouseLeftState(), agk::GetRawMouseRightState(),
+		agk::GetRawMouseMiddleState());
+	snapshot.mousePressed = MouseBits(agk::GetRawMouseLeftPressed(), agk::GetRawMouseRightPressed(),
+		agk::GetRawMouseMiddlePressed());
+	snapshot.mouseReleased = MouseBits(agk::GetRawMouseLeftReleased(), agk::GetRawMouseRightReleased(),
+		agk::GetRawMouseMiddleReleased());
+	memset(snapshot.keys, 0, sizeof(snapshot.keys));
+	memset(snapshot.keysPressed, 0, sizeof(snapshot.keysPressed));
+	memset(snapshot.keysReleased, 0, sizeof(snapshot.keysReleased));
+	for (unsigned int key = 1; key < INPUT_KEY_COUNT; key++)
+	{
+		unsigned char bit = (unsigned char)(1 << (key & 7));
+		if (agk::GetRawKeyState(key))
+		{
+			snapshot.keys[key >> 3] |= bit;
+		}
+		if (agk::GetRawKeyPressed(key))
+		{
+			snapshot.keysPressed[key >> 3] |= bit;
+		}
+		if (agk::GetRawKeyReleased(key))
+		{
+			snapshot.keysReleased[key >> 3] |= bit;
+		}
+	}
+	int count = 0;
+	for (unsigned int id = agk::GetRawFirstTouchEvent(1); id != 0 && count < INPUT_MAX_TOUCHES;
+		id = agk::GetRawNextTouchEvent())
+	{
+		InputTouch &touch = snapshot.touches[count++];
+		touch.id = id;
+		touch.type = agk::GetRawTouchType(id);
+		touch.x = agk::GetRawTouchCurrentX(id);
+		touch.y = agk::GetRawTouchCurrentY(id);
+		touch.startX = agk::GetRawTouchStartX(id);
+		touch.startY = agk::GetRawTouchStartY(id);
+		touch.time = agk::GetRawTouchTime(id);
+		touch.released = agk::GetRawTouchReleased(id);
+	}
+	snapshot.touchCount = count;
+	memset(snapshot.touches + count, 0, sizeof(InputTouch) * (INPUT_MAX_TOUCHES - count));
+	for (unsigned int index = 0; index < INPUT_MAX_JOYSTICKS; index++)
+	{
+		InputJoystick &joystick = snapshot.joysticks[index];
+		memset(&joystick, 0, sizeof(joystick));
+		unsigned int agkIndex = index + 1;
+		if (!agk::GetRawJoystickExists(agkIndex))
+		{
+			continue;
+		}
+		joystick.exists = 1;
+		joystick.x = agk::GetRawJoystickX(agkIndex);
+		joystick.y = agk::GetRawJoystickY(agkIndex);
+		joystick.z = agk::GetRawJoystickZ(agkIndex);
+		joystick.rx = agk::GetRawJoystickRX(agkIndex);
+		joystick.ry = agk::GetRawJoystickRY(agkIndex);
+		joystick.rz = agk::GetRawJoystickRZ(agkIndex);
+		for (unsigned int button = 0; button < INPUT_JOYSTICK_BUTTONS; button++)
+		{
+			unsigned int bit = 1u << button;
+			if (agk::GetRawJoystickButtonState(agkIndex, button + 1))
+			{
+				joystick.buttons |= bit;
+			}
+			if (agk::GetRawJoystickButtonPressed(agkIndex, button + 1))
+			{
+				joystick.pressed |= bit;
+			}
+			if (agk::GetRawJoystickButtonReleased(agkIndex, button + 1))
+			{
+				joystick.released |= bit;
+			}
+		}
+	}
+}
+
+static PyObject *GetSnapshotView()
+{
+	return PyMemoryView_FromMemory((char *)&m_InputSnapshot, sizeof(m_InputSnapshot), PyBUF_READ);
+}
+
+AGK_THUNK(CaptureInput)
+{
+	AGK_BEGIN(CaptureInput, 0, 0)
+	CaptureInputSnapshot();
+	return GetSnapshotView();
+}
+
+AGK_THUNK(GetInputSnapshot)
+{
+	AGK_BEGIN(GetInputSnapshot, 0, 0)
+	return GetSnapshotView();
+}
+
+PyMethodDef InputSnapshotMethods[] = {
+	AGK_METHOD(CaptureInput, "CaptureInput() -> memoryview"),
+	AGK_METHOD(GetInputSnapshot, "GetInputSnapshot() -> memoryview"),
+	{ NULL, NULL, 0, NULL }
+};
+
+int AddInputSnapshotConstants(PyObject *module)
+{
+	if (PyModule_AddStringConstant(module, "INPUT_SNAPSHOT_FORMAT", INPUT_SNAPSHOT_FORMAT) == -1
+		|| PyModule_AddStringConstant(module, "INPUT_TOUCH_FORMAT", INPUT_TOUCH_FORMAT) == -1
+		|| PyModule_AddStringConstant(module, "INPUT_JOYSTICK_FORMAT", INPUT_JOYSTICK_FORMAT) == -1
+		|| PyModule_AddIntConstant(module, "INPUT_TOUCHES_OFFSET", offsetof(InputSnapshot, touches)) == -1
+		|| PyModule_AddIntConstant(module, "INPUT_JOYSTICKS_OFFSET", offsetof(InputSnapshot, joysticks)) == -1
+		|| PyModule_AddIntConstant(module, "INPUT_TOUCH_SIZE", sizeof(InputTouch)) == -1
+		|| PyModule_AddIntConstant(module, "INPUT_JOYSTICK_SIZE", sizeof(InputJoystick)) == -1
+		|| PyModule_AddIntConstant(module, "INPUT_MAX_TOUCHES", INPUT_MAX_TOUCHES) == -1
+		|| PyModule_AddIntConstant(module, "INPUT_MAX_JOYSTICKS", INPUT_MAX_JOYSTICKS) == -1)
+	{
+		return -1;
+	}
+	return 0;
+}
+
+/*
+Captures the input snapshot from AGK script, for Python to read with agk.GetInputSnapshot.
+Returns the snapshot's frame number.
+*/
+int PyInput_Capture()
+{
+	CaptureInputSnapshot();
+	return (int)m_InputSnapshot.frame;
+}
@@ -0,0 +1,285 @@
+/*
+Copyright (c) 2017 Adam Biser <adambiser@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+Sub-interpreters.
+
+PyInterp_Create makes a new sub-interpreter and PyInterp_Switch makes it the one that all other plugin commands use.
+Interpreter 0 is the main interpreter.  Each interpreter has its own list of handles, so a handle from one
+interpreter is not valid in another.  Switching swaps the active thread state and handle list, which is cheap.
+
+Creating an interpreter imports its standard modules from scratch.  PyInterp_WarmPool creates interpreters ahead
+of time with given modules already imported, and PyInterp_Acquire hands them out, so loading a level doesn't pay
+for that.
+
+Async jobs, coroutines, frame hooks and asyncio loops belong to the interpreter that was active when they were
+created, and they always run in it.  Destroying an interpreter releases them, waiting for its running job if there
+is one.  An interpreter can't be destroyed while a Python thread started in it is still running.
+*/
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "PythonPlugin.h"
+#include "PythonErrorHandling.h"
+#include "PythonThreading.h"
+#include "PluginHelpers.h"
+#ifdef PLUGIN
+#include "..\AGKLibraryCommands.h"
+#endif
+
+struct SubInterpreter
+{
+	PyThreadState *threadState;
+	// The interpreter's handles while it isn't active.  Empty while it is active.
+	std::vector<PyObject *> objects;
+};
+
+std::map<int, SubInterpreter *> m_Interpreters;
+int m_CurrentInterpreter = 0;
+int m_NextInterpreterID = 1;
+std::deque<int> m_WarmInterpreters;
+
+static SubInterpreter *GetInterpreter(int id, const char *caller)
+{
+	auto found = m_Interpreters.find(id);
+	if (found == m_Interpreters.end())
+	{
+		std::string msg = caller;
+		msg += ": Invalid interpreter id.";
+		agk::PluginError(msg.c_str());
+		return NULL;
+	}
+	return found->second;
+}
+
+// The main interpreter is added the first time a sub-interpreter is created, which is always while it is active.
+static void AddMainInterpreter()
+{
+	if (m_Interpreters.empty())
+	{
+		SubInterpreter *main = new SubInterpreter();
+		main->threadState = PyThreadState_Get();
+		m_Interpreters[0] = main;
+		m_CurrentInterpreter = 0;
+	}
+}
+
+// Requires the GIL.
+static void SwitchInterpreter(int id)
+{
+	if (id == m_CurrentInterpreter)
+	{
+		return;
+	}
+	SubInterpreter *current = m_Interpreters[m_CurrentInterpreter];
+	SubInterpreter *target = m_Interpreters[id];
+	SwapPyObjectHandleList(current->objects);
+	SwapPyObjectHandleList(target->objects);
+	PyThreadState_Swap(target->threadState);
+	m_CurrentInterpreter = id;
+	// HOLD_GIL saves whichever thread state is current when it releases the GIL, so the switch sticks.
+}
+
+ScopedInterpreter::ScopedInterpreter(int id) : m_Previous(m_CurrentInterpreter)
+{
+	SwitchInterpreter(id);
+}
+
+ScopedInterpreter::~ScopedInterpreter()
+{
+	SwitchInterpreter(m_Previous);
+}
+
+static int CreateInterpreter()
+{
+	AddMainInterpreter();
+	PyThreadState *previous = PyThreadState_Get();
+	PyThreadState *threadState = Py_NewInterpreter();
+	PyThreadState_Swap(previous);
+	if (threadState == NULL)
+	{
+		agk::PluginError("PyInterp_Create: Could not create the interpreter.");
+		return 0;
+	}
+	SubInterpreter *interpreter = new SubInterpreter();
+	interpreter->threadState = threadState;
+	interpreter->objects.push_back(Py_None); // Store Py_None as handle 1.
+	int id = m_NextInterpreterID++;
+	m_Interpreters[id] = interpreter;
+	return id;
+}
+
+static bool DestroyInterpreter(int id)
+{
+	if (id == m_CurrentInterpreter)
+	{
+		SwitchInterpreter(0);
+	}
+	SubInterpreter *interpreter = m_Interpreters[id];
+	PyThreadState *previous = PyThreadState_Swap(interpreter->threadState);
+	if (!ReleaseInterpreterJobs(id))
+	{
+		PyThreadState_Swap(previous);
+		return false;
+	}
+	ReleaseInterpreterCoroutines(id);
+	ReleaseInterpreterHooks(id);
+	ReleaseInterpreterLoop(id);
+	Py_EndInterpreter(interpreter->threadState);
+	PyThreadState_Swap(previous);
+	m_Interpreters.erase(id);
+	m_WarmInterpreters.erase(std::remove(m_WarmInterpreters.begin(), m_WarmInterpreters.end(), id), m_WarmInterpreters.end());
+	delete interpreter;	return true;
+}
+
+/*
+Creates a new sub-interpreter and returns its id.  It does not become active until PyInterp_Switch is called.
+*/
+int PyInterp_Create()
+{
+	HOLD_GIL
+	return CreateInterpreter();
+}
+
+/*
+Destroys a sub-interpreter and all of its objects.  If it is active, the main interpreter becomes active.
+Fails if an async job running in the interpreter doesn't stop within JOB_STOP_TIMEOUT_MS of being interrupted.
+*/
+void PyInterp_Destroy(int id)
+{
+	HOLD_GIL
+	if (id == 0)
+	{
+		agk::PluginError("PyInterp_Destroy: The main interpreter can't be destroyed.  Use Py_Finalize.");
+		return;
+	}
+	if (GetInterpreter(id, __FUNCTION__))
+	{
+		DestroyInterpreter(id);
+	}
+}
+
+/*
+Makes an interpreter active.  Returns the id of the one that was active.
+*/
+int PyInterp_Switch(int id)
+{
+	HOLD_GIL
+	int previous = m_CurrentInterpreter;
+	if (id != previous && GetInterpreter(id, __FUNCTION__))
+	{
+		SwitchInterpreter(id);
+	}
+	return previous;
+}
+
+int PyInterp_GetCurrent()
+{
+	return m_CurrentInterpreter;
+}
+
+/*
+Creates interpreters until the warm pool holds count of them.  Each one imports the given comma-separated modules.
+Returns the number of interpreters in the pool.
+*/
+int PyInterp_WarmPool(int count, const char *modules)
+{
+	HOLD_GIL
+	std::vector<std::string> names;
+	std::string list = modules;
+	size_t start = 0;
+	while (start < list.size())
+	{
+		size_t end = std::min(list.find(',', start), list.size());
+		size_t first = list.find_first_not_of(" \t", start);
+		size_t last = list.find_last_not_of(" \t", end - 1);
+		if (first < end && last != std::string::npos && last >= first)
+		{
+			names.push_back(list.substr(first, last - first + 1));
+		}
+		start = end + 1;
+	}
+	while ((int)m_WarmInterpreters.size() < count)
+	{
+		int id = CreateInterpreter();
+		if (id == 0)
+		{
+			break;
+		}
+		int previous = m_CurrentInterpreter;
+		SwitchInterpreter(id);
+		for (const std::string &name : names)
+		{
+			PyObject *module = PyImport_ImportModule(name.c_str());
+			Py_XDECREF(module);
+			CheckError();
+		}
+		SwitchInterpreter(previous);
+		m_WarmInterpreters.push_back(id);
+	}
+	return (int)m_WarmInterpreters.size();
+}
+
+/*
+Takes an interpreter from the warm pool, or creates a new one if the pool is empty.  Returns its id.
+*/
+int PyInterp_Acquire()
+{
+	HOLD_GIL
+	if (m_WarmInterpreters.empty())
+	{
+		return CreateInterpreter();
+	}
+	int id = m_WarmInterpreters.front();
+	m_WarmInterpreters.pop_front();
+	return id;
+}
+
+int PyInterp_GetPoolSize()
+{
+	return (int)m_WarmInterpreters.size();
+}
+
+void ShutdownInterpreters()
+{
+	if (m_Interpreters.empty())
+	{
+		return;
+	}
+	SwitchInterpreter(0);
+	while (m_Interpreters.size() > 1)
+	{
+		// ShutdownAsyncJobs has already stopped every job, so this only fails if that changes.
+		if (!DestroyInterpreter(m_Interpreters.rbegin()->first))
+		{
+			break;
+		}
+	}
+	delete m_Interpreters[0];
+	m_Interpreters.clear();
+	m_WarmInterpreters.clear();
+	m_NextInterpreterID = 1;
+}
@@ -0,0 +1,667 @@
+/*
+Copyright (c) 2017 Adam Biser <adambiser@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+JSON bridge.
+
+Converts Python containers straight to and from JSON text without going through the json module or walking
+the containers from AGK script one item at a time.  This is meant to pair with the .toJSON and .fromJSON
+commands of AGK types.
+
+Mappings: dict <-> object, list/tuple -> array -> list, str <-> string, int/float <-> number,
+True/False <-> true/false, None <-> null.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+
+#include "PythonPlugin.h"
+#include "PythonErrorHandling.h"
+#include "PluginHelpers.h"
+#include "PythonThreading.h"
+#ifdef PLUGIN
+#include "..\AGKLibraryCommands.h"
+#endif
+
+// Guards against runaway recursion from self-referencing containers and deeply nested documents.
+#define JSON_MAX_DEPTH 512
+
+class JsonWriter
+{
+public:
+	std::string m_Text;
+
+	bool Write(PyObject *object, int depth)
+	{
+		if (depth > JSON_MAX_DEPTH)
+		{
+			PyErr_SetString(PyExc_ValueError, "Object is nested too deeply or contains a circular reference.");
+			return false;
+		}
+		if (object == Py_None)
+		{
+			m_Text += "null";
+			return true;
+		}
+		if (object == Py_True)
+		{
+			m_Text += "true";
+			return true;
+		}
+		if (object == Py_False)
+		{
+			m_Text += "false";
+			return true;
+		}
+		if (PyUnicode_Check(object))
+		{
+			return WriteString(object);
+		}
+		if (PyLong_Check(object))
+		{
+			return WriteLong(object);
+		}
+		if (PyFloat_Check(object))
+		{
+			return WriteDouble(PyFloat_AS_DOUBLE(object));
+		}
+		if (PyDict_Check(object))
+		{
+			m_Text += '{';
+			Py_ssize_t pos = 0;
+			PyObject *key, *value; // borrowed refs
+			bool first = true;
+			while (PyDict_Next(object, &pos, &key, &value))
+			{
+				if (!first)
+				{
+					m_Text += ',';
+				}
+				first = false;
+				if (!WriteKey(key) || !Write(value, depth + 1))
+				{
+					return false;
+				}
+			}
+			m_Text += '}';
+			return true;
+		}
+		if (PyList_Check(object) || PyTuple_Check(object))
+		{
+			m_Text += '[';
+			// List items are fetched by index each time because a list can change size during a nested str() call.
+			for (Py_ssize_t index = 0; index < PySequence_Fast_GET_SIZE(object); index++)
+			{
+				if (index > 0)
+				{
+					m_Text += ',';
+				}
+				if (!Write(PySequence_Fast_GET_ITEM(object, index), depth + 1))
+				{
+					return false;
+				}
+			}
+			m_Text += ']';
+			return true;
+		}
+		PyErr_Format(PyExc_TypeError, "Object of type '%.200s' is not JSON serializable.", Py_TYPE(object)->tp_name);
+		return false;
+	}
+
+private:
+	bool WriteKey(PyObject *key)
+	{
+		if (PyUnicode_Check(key))
+		{
+			WriteString(key);
+		}
+		else if (key == Py_None || PyBool_Check(key) || PyLong_Check(key) || PyFloat_Check(key))
+		{
+			// Same as the json module: scalar keys are written as their JSON text inside quotes.
+			m_Text += '"';
+			Write(key, 0);
+			m_Text += '"';
+		}
+		else
+		{
+			PyErr_Format(PyExc_TypeError, "Dictionary keys of type '%.200s' are not JSON serializable.", Py_TYPE(key)->tp_name);
+			return false;
+		}
+		m_Text += ':';
+		return !PyErr_Occurred();
+	}
+
+	bool WriteString(PyObject *object)
+	{
+		Py_ssize_t length;
+		// The UTF-8 form is cached on the object, so this does not allocate for ASCII strings.
+		const char *text = PyUnicode_AsUTF8AndSize(object, &length);
+		if (text == NULL)
+		{
+			return false;
+		}
+		static const char *hex = "0123456789abcdef";
+		m_Text += '"';
+		const char *run = text;
+		for (const char *c = text; c < text + length; c++)
+		{
+			unsigned char ch = (unsigned char)*c;
+			if (ch >= 0x20 && ch != '"' && ch != '\\')
+			{
+				continue;
+			}
+			// Copy the run of characters that don't need escaping.
+			m_Text.append(run, c - run);
+			run = c + 1;
+			switch (ch)
+			{
+			case '"': m_Text += "\\\""; break;
+			case '\\': m_Text += "\\\\"; break;
+			case '\n': m_Text += "\\n"; break;
+			case '\r': m_Text += "\\r"; break;
+			case '\t': m_Text += "\\t"; break;
+			case '\b': m_Text += "\\b"; break;
+			case '\f': m_Text += "\\f"; break;
+			default:
+				m_Text += "\\u00";
+				m_Text += hex[ch >> 4];
+				m_Text += hex[ch & 0xf];
+				break;
+			}
+		}
+		m_Text.append(run, text + length - run);
+		m_Text += '"';
+		return true;
+	}
+
+	bool WriteLong(PyObject *object)
+	{
+		int overflow;
+		long long value = PyLong_AsLongLongAndOverflow(object, &overflow);
+		if (overflow == 0)
+		{
+			if (value == -1 && PyErr_Occurred())
+			{
+				return false;
+			}
+			char buffer[32];
+			snprintf(buffer, sizeof(buffer), "%lld", value);
+			m_Text += buffer;
+			return true;
+		}
+		// Arbitrarily large integers.
+		PyObject *text = PyObject_Str(object);
+		if (text == NULL)
+		{
+			return false;
+		}
+		m_Text += PyUnicode_AsUTF8(text);
+		Py_DECREF(text);
+		return true;
+	}
+
+	bool WriteDouble(double value)
+	{
+		if (!Py_IS_FINITE(value))
+		{
+			PyErr_SetString(PyExc_ValueError, "Out of range float values are not JSON compliant.");
+			return false;
+		}
+		// Shortest representation that round-trips, the same as repr(float).
+		char *text = PyOS_double_to_string(value, 'r', 0, Py_DTSF_ADD_DOT_0, NULL);
+		if (text == NULL)
+		{
+			return false;
+		}
+		m_Text += text;
+		PyMem_Free(text);
+		return true;
+	}
+};
+
+class JsonReader
+{
+public:
+	JsonReader(const char *text) : m_Start(text), m_Current(text)
+	{
+	}
+
+	~JsonReader()
+	{
+		for (auto &entry : m_Keys)
+		{
+			Py_DECREF(entry.second);
+		}
+	}
+
+	// Returns a new reference to the parsed document or NULL with a Python error set.
+	PyObject *ReadDocument()
+	{
+		PyObject *result = Read(0);
+		if (result != NULL)
+		{
+			SkipWhitespace();
+			if (*m_Current != '\0')
+			{
+				Py_DECREF(result);
+				return Fail("Extra data after the JSON value");
+			}
+		}
+		return result;
+	}
+
+private:
+	const char *m_Start;
+	const char *m_Current;
+	std::string m_Buffer;
+	// Object keys tend to repeat, so each distinct key string is only created once per document.
+	std::unordered_map<std::string, PyObject *> m_Keys;
+
+	PyObject *Fail(const char *message)
+	{
+		PyErr_Format(PyExc_ValueError, "%s at position %d.", message, (int)(m_Current - m_Start));
+		return NULL;
+	}
+
+	void SkipWhitespace()
+	{
+		while (*m_Current == ' ' || *m_Current == '\t' || *m_Current == '\n' || *m_Current == '\r')
+		{
+			m_Current++;
+		}
+	}
+
+	bool Match(const char *literal)
+	{
+		size_t length = strlen(literal);
+		if (strncmp(m_Current, literal, length) == 0)
+		{
+			m_Current += length;
+			return true;
+		}
+		return false;
+	}
+
+	PyObject *Read(int depth)
+	{
+		if (depth > JSON_MAX_DEPTH)
+		{
+			return Fail("Document is nested too deeply");
+		}
+		SkipWhitespace();
+		switch (*m_Current)
+		{
+		case '{':
+			return ReadObject(depth);
+		case '[':
+			return ReadArray(depth);
+		case '"':
+			return ReadString(false);
+		case 't':
+			if (Match("true"))
+			{
+				Py_RETURN_TRUE;
+			}
+			break;
+		case 'f':
+			if (Match("false"))
+			{
+				Py_RETURN_FALSE;
+			}
+			break;
+		case 'n':
+			if (Match("null"))
+			{
+				Py_RETURN_NONE;
+			}
+			break;
+		default:
+			if (*m_Current == '-' || (*m_Current >= '0' && *m_Current <= '9'))
+			{
+				return ReadNumber();
+			}
+			break;
+		}
+		return Fail("Expected a JSON value");
+	}
+
+	PyObject *ReadObject(int depth)
+	{
+		m_Current++; // {
+		PyObject *dict = PyDict_New();
+		if (dict == NULL)
+		{
+			return NULL;
+		}
+		SkipWhitespace();
+		if (*m_Current == '}')
+		{
+			m_Current++;
+			return dict;
+		}
+		while (true)
+		{
+			SkipWhitespace();
+			if (*m_Current != '"')
+			{
+				Py_DECREF(dict);
+				return Fail("Expected a property name");
+			}
+			PyObject *key = ReadString(true); // borrowed from the key cache
+			if (key == NULL)
+			{
+				Py_DECREF(dict);
+				return NULL;
+			}
+			SkipWhitespace();
+			if (*m_Current != ':')
+			{
+				Py_DECREF(dict);
+				return Fail("Expected ':'");
+			}
+			m_Current++;
+			PyObject *value = Read(depth + 1);
+			if (value == NULL || PyDict_SetItem(dict, key, value) == -1)
+			{
+				Py_XDECREF(value);
+				Py_DECREF(dict);
+				return NULL;
+			}
+			Py_DECREF(value);
+			SkipWhitespace();
+			if (*m_Current == ',')
+			{
+				m_Current++;
+				continue;
+			}
+			if (*m_Current == '}')
+			{
+				m_Current++;
+				return dict;
+			}
+			Py_DECREF(dict);
+			return Fail("Expected ',' or '}'");
+		}
+	}
+
+	PyObject *ReadArray(int depth)
+	{
+		m_Current++; // [
+		PyObject *list = PyList_New(0);
+		if (list == NULL)
+		{
+			return NULL;
+		}
+		SkipWhitespace();
+		if (*m_Current == ']')
+		{
+			m_Current++;
+			return list;
+		}
+		while (true)
+		{
+			PyObject *value = Read(depth + 1);
+			if (value == NULL || PyList_Append(list, value) == -1)
+			{
+				Py_XDECREF(value);
+				Py_DECREF(list);
+				return NULL;
+			}
+			Py_DECREF(value);
+			SkipWhitespace();
+			if (*m_Current == ',')
+			{
+				m_Current++;
+				continue;
+			}
+			if (*m_Current == ']')
+			{
+				m_Current++;
+				return list;
+			}
+			Py_DECREF(list);
+			return Fail("Expected ',' or ']'");
+		}
+	}
+
+	static int HexValue(char c)
+	{
+		if (c >= '0' && c <= '9') return c - '0';
+		if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+		if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+		return -1;
+	}
+
+	bool ReadHex4(unsigned int &value)
+	{
+		value = 0;
+		for (int index = 0; index < 4; index++)
+		{
+			int digit = HexValue(m_Current[index]);
+			if (digit < 0)
+			{
+				return false;
+			}
+			value = (value << 4) | digit;
+		}
+		m_Current += 4;
+		return true;
+	}
+
+	void AppendUTF8(unsigned int cp)
+	{
+		if (cp < 0x80)
+		{
+			m_Buffer += (char)cp;
+		}
+		else if (cp < 0x800)
+		{
+			m_Buffer += (char)(0xc0 | (cp >> 6));
+			m_Buffer += (char)(0x80 | (cp & 0x3f));
+		}
+		else if (cp < 0x10000)
+		{
+			m_Buffer += (char)(0xe0 | (cp >> 12));
+			m_Buffer += (char)(0x80 | ((cp >> 6) & 0x3f));
+			m_Buffer += (char)(0x80 | (cp & 0x3f));
+		}
+		else
+		{
+			m_Buffer += (char)(0xf0 | (cp >> 18));
+			m_Buffer += (char)(0x80 | ((cp >> 12) & 0x3f));
+			m_Buffer += (char)(0x80 | ((cp >> 6) & 0x3f));
+			m_Buffer += (char)(0x80 | (cp & 0x3f));
+		}
+	}
+
+	/*
+	Returns a new reference to the string, or a borrowed reference from the key cache when isKey is true.
+	*/
+	PyObject *ReadString(bool isKey)
+	{
+		m_Current++; // "
+		const char *start = m_Current;
+		// Fast path: no escapes, so the string can be decoded straight from the document text.
+		while (*m_Current != '"' && *m_Current != '\\' && *m_Current != '\0')
+		{
+			m_Current++;
+		}
+		const char *text = start;
+		size_t length = m_Current - start;
+		if (*m_Current == '\\')
+		{
+			m_Buffer.assign(start, length);
+			while (*m_Current != '"')
+			{
+				if (*m_Current == '\0')
+				{
+					return Fail("Unterminated string");
+				}
+				if (*m_Current != '\\')
+				{
+					m_Buffer += *m_Current++;
+					continue;
+				}
+				m_Current++;
+				char escape = *m_Current++;
+				switch (escape)
+				{
+				case '"': m_Buffer += '"'; break;
+				case '\\': m_Buffer += '\\'; break;
+				case '/': m_Buffer += '/'; break;
+				case 'b': m_Buffer += '\b'; break;
+				case 'f': m_Buffer += '\f'; break;
+				case 'n': m_Buffer += '\n'; break;
+				case 'r': m_Buffer += '\r'; break;
+				case 't': m_Buffer += '\t'; break;
+				case 'u':
+				{
+					unsigned int cp;
+					if (!ReadHex4(cp))
+					{
+						return Fail("Invalid \\u escape");
+					}
+					// Combine UTF-16 surrogate pairs.
+					if (cp >= 0xd800 && cp <= 0xdbff && m_Current[0] == '\\' && m_Current[1] == 'u')
+					{
+						const char *save = m_Current;
+						m_Current += 2;
+						unsigned int low;
+						if (ReadHex4(low) && low >= 0xdc00 && low <= 0xdfff)
+						{
+							cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+						}
+						else
+						{
+							m_Current = save;
+						}
+					}
+					AppendUTF8(cp);
+					break;
+				}
+				default:
+					m_Current--;
+					return Fail("Invalid escape");
+				}
+			}
+			text = m_Buffer.data();
+			length = m_Buffer.size();
+		}
+		else if (*m_Current == '\0')
+		{
+			return Fail("Unterminated string");
+		}
+		m_Current++; // "
+		if (isKey)
+		{
+			std::string key(text, length);
+			auto found = m_Keys.find(key);
+			if (found != m_Keys.end())
+			{
+				return found->second;
+			}
+			PyObject *object = PyUnicode_DecodeUTF8(text, length, "surrogatepass");
+			if (object != NULL)
+			{
+				m_Keys.emplace(std::move(key), object);
+			}
+			return object;
+		}
+		return PyUnicode_DecodeUTF8(text, length, "surrogatepass");
+	}
+
+	PyObject *ReadNumber()
+	{
+		const char *start = m_Current;
+		bool isFloat = false;
+		if (*m_Current == '-')
+		{
+			m_Current++;
+		}
+		if (*m_Current < '0' || *m_Current > '9')
+		{
+			return Fail("Invalid number");
+		}
+		while ((*m_Current >= '0' && *m_Current <= '9') || *m_Current == '.' || *m_Current == 'e' || *m_Current == 'E'
+			|| ((*m_Current == '+' || *m_Current == '-') && (m_Current[-1] == 'e' || m_Current[-1] == 'E')))
+		{
+			isFloat = isFloat || *m_Current == '.' || *m_Current == 'e' || *m_Current == 'E';
+			m_Current++;
+		}
+		std::string number(start, m_Current - start);
+		char *end;
+		if (isFloat)
+		{
+			double value = PyOS_string_to_double(number.c_str(), &end, NULL);
+			if (value == -1.0 && PyErr_Occurred())
+			{
+				return NULL;
+			}
+			if (*end != '\0')
+			{
+				m_Current = start;
+				return Fail("Invalid number");
+			}
+			return PyFloat_FromDouble(value);
+		}
+		if (number.size() < 19)
+		{
+			return PyLong_FromLongLong(strtoll(number.c_str(), &end, 10));
+		}
+		// Too long for a long long.
+		return PyLong_FromString(number.c_str(), NULL, 10);
+	}
+};
+
+/*
+Returns the JSON text for the given object tree as UTF-8.  Returns an empty string on error.
+*/
+char *PyObjectToJSON(int hobject)
+{
+	HOLD_GIL
+	PyObject *object = GetPyObject(hobject);
+	if (object == NULL)
+	{
+		return CreateString("null");
+	}
+	JsonWriter writer;
+	if (!writer.Write(object, 0))
+	{
+		CheckError();
+		return CreateString((const char *)NULL);
+	}
+	return CreateString(writer.m_Text.c_str());
+}
+
+/*
+Builds Python objects from JSON text.  Returns a handle to a new reference.
+*/
+int PyObjectFromJSON(const char *json)
+{
+	HOLD_GIL
+	JsonReader reader(json);
+	PyObject *result = reader.ReadDocument();
+	CheckError();
+	return GetHandle(result);
+}
@@ -0,0 +1,261 @@
+/*
+Copyright (c) 2017 Adam Biser <adambiser@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+Message queue from Python threads to the AGK main thread.
+
+Python code posts messages with the built-in agkmsg module:
+
+	import agkmsg
+	agkmsg.post(kind, payload)	# kind is an int, payload is bytes, a buffer or a str
+
+AGK drains them with PyMsg_Drain, which copies a batch of messages into a memblock.  Each message is written as:
+
+	int kind, int size, size bytes of payload, then zero bytes padding it to a multiple of 4 bytes
+
+The queue is an intrusive multiple-producer, single-consumer linked list, so posting never blocks and draining
+does not take the GIL.
+*/
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+
+#include "PythonPlugin.h"
+#include "PythonErrorHandling.h"
+#include "PythonThreading.h"
+#include "PluginHelpers.h"
+#ifdef PLUGIN
+#include "..\AGKLibraryCommands.h"
+#endif
+
+#define MESSAGE_HEADER_SIZE	8
+
+struct MessageNode
+{
+	std::atomic<MessageNode *> next;
+	int kind;
+	int size;
+	char payload[1];
+};
+
+// Producers push at the head and the consumer pops from the tail.  The stub keeps the list from ever being empty.
+MessageNode m_MessageStub;
+std::atomic<MessageNode *> m_MessageHead(&m_MessageStub);
+MessageNode *m_MessageTail = &m_MessageStub;
+std::atomic<int> m_MessageCount(0);
+// A message that did not fit in the last drain's memblock.
+MessageNode *m_HeldMessage = NULL;
+
+static void PushMessage(MessageNode *node)
+{
+	node->next.store(NULL, std::memory_order_relaxed);
+	MessageNode *previous = m_MessageHead.exchange(node, std::memory_order_acq_rel);
+	previous->next.store(node, std::memory_order_release);
+}
+
+// Only called from the main thread.  Returns NULL when the queue is empty or a producer is midway through a push.
+static MessageNode *PopMessage()
+{
+	MessageNode *tail = m_MessageTail;
+	MessageNode *next = tail->next.load(std::memory_order_acquire);
+	if (tail == &m_MessageStub)
+	{
+		if (next == NULL)
+		{
+			return NULL;
+		}
+		m_MessageTail = tail = next;
+		next = next->next.load(std::memory_order_acquire);
+	}
+	if (next)
+	{
+		m_MessageTail = next;
+		return tail;
+	}
+	if (tail != m_MessageHead.load(std::memory_order_acquire))
+	{
+		return NULL;
+	}
+	PushMessage(&m_MessageStub);
+	next = tail->next.load(std::memory_order_acquire);
+	if (next)
+	{
+		m_MessageTail = next;
+		return tail;
+	}
+	return NULL;
+}
+
+/*
+agkmsg module.
+*/
+static PyObject *agkmsg_post(PyObject *self, PyObject *args)
+{
+	int kind;
+	PyObject *payload = NULL;
+	if (!PyArg_ParseTuple(args, "i|O:post", &kind, &payload))
+	{
+		return NULL;
+	}
+	const char *data = NULL;
+	Py_ssize_t size = 0;
+	Py_buffer buffer;
+	buffer.obj = NULL;
+	if (payload && PyUnicode_Check(payload))
+	{
+		data = PyUnicode_AsUTF8AndSize(payload, &size);
+		if (data == NULL)
+		{
+			return NULL;
+		}
+	}
+	else if (payload && payload != Py_None)
+	{
+		if (PyObject_GetBuffer(payload, &buffer, PyBUF_SIMPLE) == -1)
+		{
+			return NULL;
+		}
+		data = (const char *)buffer.buf;
+		size = buffer.len;
+	}
+	MessageNode *node = (MessageNode *)malloc(sizeof(MessageNode) + size);
+	if (node == NULL)
+	{
+		PyBuffer_Release(&buffer);
+		return PyErr_NoMemory();
+	}
+	new (&node->next) std::atomic<MessageNode *>(NULL);
+	node->kind = kind;
+	node->size = (int)size;
+	if (size)
+	{
+		memcpy(node->payload, data, size);
+	}
+	if (buffer.obj)
+	{
+		PyBuffer_Release(&buffer);
+	}
+	PushMessage(node);
+	m_MessageCount.fetch_add(1, std::memory_order_relaxed);
+	Py_RETURN_NONE;
+}
+
+static PyObject *agkmsg_pending(PyObject *self, PyObject *args)
+{
+	return PyLong_FromLong(m_MessageCount.load(std::memory_order_relaxed));
+}
+
+static PyMethodDef AgkMsgMethods[] = {
+	{ "post", agkmsg_post, METH_VARARGS, "post(kind, payload=None)\n\nQueues a message for the AGK main thread." },
+	{ "pending", agkmsg_pending, METH_NOARGS, "pending()\n\nReturns the number of messages that have not been drained." },
+	{ NULL, NULL, 0, NULL }
+};
+
+static PyModuleDef AgkMsgModule = {
+	PyModuleDef_HEAD_INIT, "agkmsg", "Message queue to the AGK main thread.", -1, AgkMsgMethods
+};
+
+static PyObject *PyInit_agkmsg()
+{
+	return PyModule_Create(&AgkMsgModule);
+}
+
+void RegisterMessageQueueModule()
+{
+	RegisterBuiltinModule("agkmsg", PyInit_agkmsg);
+}
+
+/*
+Copies up to maxCount messages into a memblock, starting at offset 0.  See the top of this file for the layout.
+Messages that don't fit are left for the next drain.  Returns the number of messages copied.
+*/
+int PyMsg_Drain(int memID, int maxCount)
+{
+	unsigned char *start = GetMemblockRange(memID, 0, 0);
+	if (start == NULL)
+	{
+		return 0;
+	}
+	int capacity = agk::GetMemblockSize(memID);
+	int offset = 0;
+	int count = 0;
+	while (count < maxCount)
+	{
+		MessageNode *node = (m_HeldMessage) ? m_HeldMessage : PopMessage();
+		m_HeldMessage = NULL;
+		if (node == NULL)
+		{
+			break;
+		}
+		int size = MESSAGE_HEADER_SIZE + ((node->size + 3) & ~3);
+		if (size > capacity)
+		{
+			agk::PluginError("PyMsg_Drain: A message is larger than the memblock.  It was dropped.");
+			free(node);
+			m_MessageCount.fetch_sub(1, std::memory_order_relaxed);
+			continue;
+		}
+		if (offset + size > capacity)
+		{
+			m_HeldMessage = node;
+			break;
+		}
+		memcpy(start + offset, &node->kind, sizeof(int));
+		memcpy(start + offset + sizeof(int), &node->size, sizeof(int));
+		memcpy(start + offset + MESSAGE_HEADER_SIZE, node->payload, node->size);
+		memset(start + offset + MESSAGE_HEADER_SIZE + node->size, 0, size - MESSAGE_HEADER_SIZE - node->size);
+		offset += size;
+		count++;
+		free(node);
+		m_MessageCount.fetch_sub(1, std::memory_order_relaxed);
+	}
+	return count;
+}
+
+/*
+Returns the number of messages that have been posted but not drained.
+*/
+int PyMsg_GetPendingCount()
+{
+	return m_MessageCount.load(std::memory_order_relaxed);
+}
+
+/*
+Discards all pending messages.
+*/
+void PyMsg_Clear()
+{
+	if (m_HeldMessage)
+	{
+		free(m_HeldMessage);
+		m_HeldMessage = NULL;
+		m_MessageCount.fetch_sub(1, std::memory_order_relaxed);
+	}
+	while (MessageNode *node = PopMessage())
+	{
+		free(node);
+		m_MessageCount.fetch_sub(1, std::memory_order_relaxed);
+	}
+}
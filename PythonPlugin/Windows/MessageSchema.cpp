@@ -0,0 +1,533 @@
+/*
+Copyright (c) 2017 Adam Biser <adambiser@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+Network message schemas.
+
+agk.MessageSchema describes the fields of an AGK network message so that a whole Python value is written to or read
+from a message in one call, instead of one AddNetworkMessage* or GetNetworkMessage* call per field from AGK script:
+
+	state = agk.MessageSchema("iffs?", ("id", "x", "y", "name", "alive"))
+	msg = state.encode({"id": 7, "x": 1.5, "y": 2.0, "name": "bob", "alive": True})
+	agk.SendNetworkMessage(net, 0, msg)
+	...
+	value = state.decode(msg)			# {"id": 7, "x": 1.5, ...}
+
+Field types are i (integer), f (float), s (string) and ? (bool, sent as an integer).  Without names, values are
+sequences and decode returns tuples.  encode creates a message unless one is given to append to.  The value is
+checked before anything is written, so a bad value never leaves a half-written message.
+
+send_many sends a list of values and receive_many drains a network's waiting messages, each in one call:
+
+	state.send_many(net, 0, values)			# Sends nothing if any value is bad.
+	for client, value in state.receive_many(net):	# Reports and skips messages that don't decode.
+		...
+
+AGK script uses a schema through its handle with the PyMessageSchema_* commands.
+*/
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "AgkModule.h"
+#include "PythonPlugin.h"
+#include "PythonErrorHandling.h"
+#include "PythonThreading.h"
+#include "PluginHelpers.h"
+#ifdef PLUGIN
+#include "..\AGKLibraryCommands.h"
+#endif
+
+struct MessageSchemaObject
+{
+	PyObject_HEAD
+	std::string *types;
+	PyObject *names; // A tuple of str, or NULL for sequences.
+};
+
+// A field value converted before anything is written to the message.
+struct FieldValue
+{
+	int i;
+	float f;
+	const char *s;
+};
+
+static PyObject *MessageSchema_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+	const char *format;
+	PyObject *namesArg = Py_None;
+	if (!PyArg_ParseTuple(args, "s|O:MessageSchema", &format, &namesArg))
+	{
+		return NULL;
+	}
+	for (const char *type = format; *type; type++)
+	{
+		if (strchr("ifs?", *type) == NULL)
+		{
+			PyErr_Format(PyExc_ValueError, "agk.MessageSchema: Unknown field type '%c'.  Use i, f, s or ?.", *type);
+			return NULL;
+		}
+	}
+	PyObject *names = NULL;
+	if (namesArg != Py_None)
+	{
+		names = PySequence_Tuple(namesArg);
+		if (names == NULL)
+		{
+			return NULL;
+		}
+		if (PyTuple_GET_SIZE(names) != (Py_ssize_t)strlen(format))
+		{
+			PyErr_Format(PyExc_ValueError, "agk.MessageSchema: %zd names were given for %zd fields.",
+				PyTuple_GET_SIZE(names), (Py_ssize_t)strlen(format));
+			Py_DECREF(names);
+			return NULL;
+		}
+	}
+	MessageSchemaObject *self = (MessageSchemaObject *)type->tp_alloc(type, 0);
+	if (self == NULL)
+	{
+		Py_XDECREF(names);
+		return NULL;
+	}
+	self->types = new std::string(format);
+	self->names = names;
+	return (PyObject *)self;
+}
+
+static void MessageSchema_dealloc(MessageSchemaObject *self)
+{
+	delete self->types;
+	Py_XDECREF(self->names);
+	PyTypeObject *type = Py_TYPE(self);
+	type->tp_free(self);
+	Py_DECREF(type);
+}
+
+/*
+Converts one field.  The str object must stay alive until the value has been written.
+*/
+static bool ConvertField(char type, PyObject *item, FieldValue &value, MessageSchemaObject *schema, Py_ssize_t index)
+{
+	bool converted;
+	switch (type)
+	{
+	case 'i':
+		converted = ToInt(item, value.i);
+		break;
+	case 'f':
+		converted = ToFloat(item, value.f);
+		break;
+	case '?':
+		value.i = PyObject_IsTrue(item);
+		converted = value.i != -1;
+		break;
+	default:
+		converted = PyUnicode_Check(item) && ToString(item, value.s);
+		if (!converted && !PyErr_Occurred())
+		{
+			PyErr_SetString(PyExc_TypeError, "expected str");
+		}
+		break;
+	}
+	if (!converted)
+	{
+		// Name the field in the error.
+		PyObject *type, *message, *traceback;
+		PyErr_Fetch(&type, &message, &traceback);
+		PyErr_NormalizeException(&type, &message, &traceback);
+		if (schema->names)
+		{
+			PyErr_Format(type, "agk.MessageSchema: Field '%U': %S", PyTuple_GET_ITEM(schema->names, index), message);
+		}
+		else
+		{
+			PyErr_Format(type, "agk.MessageSchema: Field %zd: %S", index, message);
+		}
+		Py_XDECREF(type);
+		Py_XDECREF(message);
+		Py_XDECREF(traceback);
+	}
+	return converted;
+}
+
+/*
+Writes a value to a message, creating one when msgID is 0.  Returns the message ID or 0 with a Python exception set.
+*/
+static unsigned int EncodeValue(MessageSchemaObject *schema, PyObject *value, unsigned int msgID)
+{
+	const std::string &types = *schema->types;
+	Py_ssize_t count = (Py_ssize_t)types.size();
+	// Holds the items, which keep the converted strings alive.
+	std::vector<PyObject *> items((size_t)count, NULL);
+	std::vector<FieldValue> values((size_t)count);
+	bool ok = true;
+	if (schema->names)
+	{
+		for (Py_ssize_t index = 0; index < count && ok; index++)
+		{
+			PyObject *name = PyTuple_GET_ITEM(schema->names, index);
+			items[index] = PyObject_GetItem(value, name);
+			ok = items[index] != NULL && ConvertField(types[index], items[index], values[index], schema, index);
+		}
+	}
+	else
+	{
+		PyObject *sequence = PySequence_Fast(value, "agk.MessageSchema: A schema without names encodes sequences.");
+		if (sequence == NULL)
+		{
+			return 0;
+		}
+		if (PySequence_Fast_GET_SIZE(sequence) != count)
+		{
+			PyErr_Format(PyExc_ValueError, "agk.MessageSchema: The value has %zd items but the schema has %zd fields.",
+				PySequence_Fast_GET_SIZE(sequence), count);
+			ok = false;
+		}
+		for (Py_ssize_t index = 0; index < count && ok; index++)
+		{
+			items[index] = PySequence_Fast_GET_ITEM(sequence, index);
+			Py_INCREF(items[index]);
+			ok = ConvertField(types[index], items[index], values[index], schema, index);
+		}
+		Py_DECREF(sequence);
+	}
+	if (ok)
+	{
+		if (msgID == 0)
+		{
+			msgID = agk::CreateNetworkMessage();
+		}
+		for (Py_ssize_t index = 0; index < count; index++)
+		{
+			switch (types[index])
+			{
+			case 'f':
+				agk::AddNetworkMessageFloat(msgID, values[index].f);
+				break;
+			case 's':
+				agk::AddNetworkMessageString(msgID, values[index].s);
+				break;
+			default:
+				agk::AddNetworkMessageInteger(msgID, values[index].i);
+				break;
+			}
+		}
+	}
+	for (PyObject *item : items)
+	{
+		Py_XDECREF(item);
+	}
+	return (ok) ? msgID : 0;
+}
+
+/*
+Reads a value from a message.  Returns a new reference or NULL with a Python exception set.
+*/
+static PyObject *DecodeValue(MessageSchemaObject *schema, unsigned int msgID)
+{
+	const std::string &types = *schema->types;
+	Py_ssize_t count = (Py_ssize_t)types.size();
+	PyObject *result = (schema->names) ? PyDict_New() : PyTuple_New(count);
+	if (result == NULL)
+	{
+		return NULL;
+	}
+	for (Py_ssize_t index = 0; index < count; index++)
+	{
+		PyObject *item;
+		switch (types[index])
+		{
+		case 'i':
+			item = PyLong_FromLong(agk::GetNetworkMessageInteger(msgID));
+			break;
+		case 'f':
+			item = PyFloat_FromDouble(agk::GetNetworkMessageFloat(msgID));
+			break;
+		case '?':
+			item = PyBool_FromLong(agk::GetNetworkMessageInteger(msgID));
+			break;
+		default:
+			item = FromString(agk::GetNetworkMessageString(msgID));
+			break;
+		}
+		if (item == NULL)
+		{
+			Py_DECREF(result);
+			return NULL;
+		}
+		if (schema->names)
+		{
+			int failed = PyDict_SetItem(result, PyTuple_GET_ITEM(schema->names, index), item);
+			Py_DECREF(item);
+			if (failed)
+			{
+				Py_DECREF(result);
+				return NULL;
+			}
+		}
+		else
+		{
+			PyTuple_SET_ITEM(result, index, item);
+		}
+	}
+	return result;
+}
+
+static PyObject *MessageSchema_encode(MessageSchemaObject *self, PyObject *args)
+{
+	PyObject *value;
+	unsigned int msgID = 0;
+	if (!PyArg_ParseTuple(args, "O|I:encode", &value, &msgID) || !CheckMainThread("agk.MessageSchema", "encode"))
+	{
+		return NULL;
+	}
+	msgID = EncodeValue(self, value, msgID);
+	return (msgID) ? PyLong_FromUnsignedLong(msgID) : NULL;
+}
+
+static PyObject *MessageSchema_decode(MessageSchemaObject *self, PyObject *args)
+{
+	unsigned int msgID;
+	if (!PyArg_ParseTuple(args, "I:decode", &msgID) || !CheckMainThread("agk.MessageSchema", "decode"))
+	{
+		return NULL;
+	}
+	return DecodeValue(self, msgID);
+}
+
+static PyObject *MessageSchema_send_many(MessageSchemaObject *self, PyObject *args)
+{
+	unsigned int netID, toClient;
+	PyObject *values;
+	if (!PyArg_ParseTuple(args, "IIO:send_many", &netID, &toClient, &values)
+		|| !CheckMainThread("agk.MessageSchema", "send_many"))
+	{
+		return NULL;
+	}
+	PyObject *sequence = PySequence_Fast(values, "agk.MessageSchema.send_many: values must be a sequence.");
+	if (sequence == NULL)
+	{
+		return NULL;
+	}
+	// Encode every value before sending any, so that a bad value sends nothing.
+	Py_ssize_t count = PySequence_Fast_GET_SIZE(sequence);
+	std::vector<unsigned int> messages;
+	messages.reserve((size_t)count);
+	for (Py_ssize_t index = 0; index < count; index++)
+	{
+		unsigned int msgID = EncodeValue(self, PySequence_Fast_GET_ITEM(sequence, index), 0);
+		if (msgID == 0)
+		{
+			for (unsigned int encoded : messages)
+			{
+				agk::DeleteNetworkMessage(encoded);
+			}
+			Py_DECREF(sequence);
+			return NULL;
+		}
+		messages.push_back(msgID);
+	}
+	Py_DECREF(sequence);
+	for (unsigned int msgID : messages)
+	{
+		agk::SendNetworkMessage(netID, toClient, msgID);
+	}
+	return PyLong_FromSsize_t(count);
+}
+
+static PyObject *MessageSchema_receive_many(MessageSchemaObject *self, PyObject *args)
+{
+	unsigned int netID;
+	Py_ssize_t maxCount = PY_SSIZE_T_MAX;
+	if (!PyArg_ParseTuple(args, "I|n:receive_many", &netID, &maxCount) || !CheckMainThread("agk.MessageSchema", "receive_many"))
+	{
+		return NULL;
+	}
+	PyObject *result = PyList_New(0);
+	if (result == NULL)
+	{
+		return NULL;
+	}
+	while (PyList_GET_SIZE(result) < maxCount)
+	{
+		unsigned int msgID = agk::GetNetworkMessage(netID);
+		if (msgID == 0)
+		{
+			break;
+		}
+		PyObject *value = DecodeValue(self, msgID);
+		if (value == NULL)
+		{
+			// The message is already gone from the network, so dropping the list would lose the ones before it too.
+			// Report the bad message and carry on with the rest.
+			agk::DeleteNetworkMessage(msgID);
+			CheckError();
+			continue;
+		}
+		PyObject *entry = Py_BuildValue("(IN)", agk::GetNetworkMessageFromClient(msgID), value);
+		agk::DeleteNetworkMessage(msgID);
+		if (entry == NULL || PyList_Append(result, entry) == -1)
+		{
+			Py_XDECREF(entry);
+			Py_DECREF(result);
+			return NULL;
+		}
+		Py_DECREF(entry);
+	}
+	return result;
+}
+
+static PyMethodDef MessageSchemaMethods[] = {
+	{ "encode", (PyCFunction)MessageSchema_encode, METH_VARARGS,
+		"encode(value, msg=0)\n\nWrites value to a new network message, or appends it to msg.  Returns the message ID." },
+	{ "decode", (PyCFunction)MessageSchema_decode, METH_VARARGS,
+		"decode(msg)\n\nReads a value from a network message." },
+	{ "send_many", (PyCFunction)MessageSchema_send_many, METH_VARARGS,
+		"send_many(net, to_client, values)\n\nEncodes and sends one message per value.  Sends nothing if any value is bad.  Returns the number sent." },
+	{ "receive_many", (PyCFunction)MessageSchema_receive_many, METH_VARARGS,
+		"receive_many(net, max_count=None)\n\nDecodes and deletes the network's waiting messages.  Returns a list of (client, value).  Messages that don't decode are reported and skipped." },
+	{ NULL, NULL, 0, NULL }
+};
+
+static PyType_Slot MessageSchemaSlots[] = {
+	{ Py_tp_new, (void *)MessageSchema_new },
+	{ Py_tp_dealloc, (void *)MessageSchema_dealloc },
+	{ Py_tp_methods, (void *)MessageSchemaMethods },
+	{ Py_tp_doc, (void *)"MessageSchema(format, names=None)\n\nThe field types and names of a network message." },
+	{ 0, NULL }
+};
+
+static PyType_Spec MessageSchemaSpec = {
+	"agk.MessageSchema", sizeof(MessageSchemaObject), 0, Py_TPFLAGS_DEFAULT, MessageSchemaSlots
+};
+
+int AddMessageSchemaType(PyObject *module)
+{
+	PyObject *type = PyType_FromSpec(&MessageSchemaSpec);
+	if (type == NULL)
+	{
+		return -1;
+	}
+	// PyModule_AddObject steals the reference.
+	if (PyModule_AddObject(module, "MessageSchema", type) == -1)
+	{
+		Py_DECREF(type);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+AGK commands.
+*/
+
+// Returns the schema for a handle or reports an error and returns NULL.
+static MessageSchemaObject *GetMessageSchema(int hschema, const char *caller)
+{
+	return (MessageSchemaObject *)GetAgkObject(hschema, (destructor)MessageSchema_dealloc, "MessageSchema", caller);
+}
+
+// Splits comma-separated names into a list of str, trimming spaces.  Returns a new reference or NULL with a Python
+// exception set.
+static PyObject *SplitNames(const char *names)
+{
+	PyObject *nameList = PyList_New(0);
+	std::string text = names;
+	size_t start = 0;
+	while (nameList != NULL)
+	{
+		size_t end = text.find(',', start);
+		std::string name = text.substr(start, (end == std::string::npos) ? std::string::npos : end - start);
+		name.erase(0, name.find_first_not_of(' '));
+		name.erase(name.find_last_not_of(' ') + 1);
+		PyObject *item = PyUnicode_FromString(name.c_str());
+		if (item == NULL || PyList_Append(nameList, item) == -1)
+		{
+			Py_CLEAR(nameList);
+		}
+		Py_XDECREF(item);
+		if (end == std::string::npos)
+		{
+			break;
+		}
+		start = end + 1;
+	}
+	return nameList;
+}
+
+/*
+Creates an agk.MessageSchema and returns its handle.  names is comma-separated, or empty for sequences.
+Py_DECREF it when done.
+*/
+int PyMessageSchema_New(const char *format, const char *names)
+{
+	HOLD_GIL
+	if (names && *names)
+	{
+		PyObject *nameList = SplitNames(names);
+		return NewAgkObject("MessageSchema", (nameList) ? Py_BuildValue("(sN)", format, nameList) : NULL);
+	}
+	return NewAgkObject("MessageSchema", Py_BuildValue("(s)", format));
+}
+
+/*
+Writes a Python value to a new network message.  Returns the message ID, or 0 on error.
+*/
+int PyMessageSchema_Encode(int hschema, int hvalue)
+{
+	HOLD_GIL
+	REQUIRED_HANDLE(hvalue)
+	MessageSchemaObject *schema = GetMessageSchema(hschema, __FUNCTION__);
+	if (schema == NULL)
+	{
+		return 0;
+	}
+	unsigned int msgID = EncodeValue(schema, GetPyObject(hvalue), 0);
+	if (msgID == 0)
+	{
+		CheckError();
+	}
+	return (int)msgID;
+}
+
+/*
+Reads a Python value from a network message and returns its handle, or 0 on error.
+*/
+int PyMessageSchema_Decode(int hschema, int msgID)
+{
+	HOLD_GIL
+	MessageSchemaObject *schema = GetMessageSchema(hschema, __FUNCTION__);
+	if (schema == NULL)
+	{
+		return 0;
+	}
+	PyObject *value = DecodeValue(schema, (unsigned int)msgID);
+	if (value == NULL)
+	{
+		CheckError();
+		return 0;
+	}
+	return GetHandle(value);
+}
@@ -0,0 +1,105 @@
+/*
+Copyright (c) 2017 Adam Biser <adambiser@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef PLUGIN_HELPERS_H_
+#define PLUGIN_HELPERS_H_
+
+#include <string>
+#include <vector>
+
+// Force use of the release build of python36.dll.
+#ifdef _DEBUG
+#undef _DEBUG
+#include <Python.h>
+#define _DEBUG
+#else
+#include <Python.h>
+#endif
+
+/*
+Shared helpers for the plugin source files.  These are defined in PythonPlugin.cpp.
+*/
+PyObject *GetPyObject(int handle);
+int GetHandle(PyObject *object);
+char *CreateString(const char *text);
+char *CreateString(PyObject *object);
+unsigned char *GetMemblockRangeEx(int memID, int offset, int size, const char *caller);
+unsigned char *GetMemblockArrayEx(int memID, int offset, Py_ssize_t count, int itemSize, const char *caller);
+void SwapPyObjectHandleList(std::vector<PyObject *> &objects);
+
+#define GetMemblockRange(memID, offset, size) GetMemblockRangeEx(memID, offset, size, __FUNCTION__)
+// Like GetMemblockRange for count items of itemSize bytes, without overflowing count * itemSize.
+#define GetMemblockArray(memID, offset, count, itemSize) GetMemblockArrayEx(memID, offset, count, itemSize, __FUNCTION__)
+
+// Appends a built-in module to the inittab unless it has already been.  Must be called before Py_Initialize.
+void RegisterBuiltinModule(const char *name, PyObject *(*init)());
+
+// Registers the built-in agkmsg module.  Defined in MessageQueue.cpp.  Must be called before Py_Initialize.
+void RegisterMessageQueueModule();
+
+// Registers the built-in agk module.  Defined in AgkModule.cpp.  Must be called before Py_Initialize.
+void RegisterAgkModule();
+
+// Registers the built-in agkimport module.  Defined in AgkImport.cpp.  Must be called before Py_Initialize.
+void RegisterAgkImportModule();
+
+// Switches back to the main interpreter and destroys the others.  Defined in Interpreters.cpp.  Called while holding the GIL.
+void ShutdownInterpreters();
+
+// Makes an interpreter active until the end of the enclosing scope.  Defined in Interpreters.cpp.  Requires the GIL.
+// Used to run stored Python objects in the interpreter that they belong to.
+class ScopedInterpreter
+{
+public:
+	explicit ScopedInterpreter(int id);
+	~ScopedInterpreter();
+private:
+	int m_Previous;
+};
+
+// Release everything that belongs to an interpreter that is about to be destroyed.  Called by Interpreters.cpp with
+// the GIL held and that interpreter's thread state current.  ReleaseInterpreterJobs returns false when a job is
+// still running, in which case the interpreter must not be destroyed.
+bool ReleaseInterpreterJobs(int id);		// AsyncJobs.cpp
+void ReleaseInterpreterCoroutines(int id);	// Scheduler.cpp
+void ReleaseInterpreterHooks(int id);		// FrameHooks.cpp
+void ReleaseInterpreterLoop(int id);		// AsyncioPump.cpp
+
+// Used to check required handles and report when they are 0.
+#define REQUIRED_HANDLEV(handle)						\
+	if (handle == 0)									\
+	{													\
+		std::string msg = __FUNCTION__;					\
+		msg += ": Given required handle was null.";		\
+		agk::PluginError(msg.c_str());					\
+		return;											\
+	}
+#define REQUIRED_HANDLE(handle)							\
+	if (handle == 0)									\
+	{													\
+		std::string msg = __FUNCTION__;					\
+		msg += ": Given required handle was null.";		\
+		agk::PluginError(msg.c_str());					\
+		return NULL;									\
+	}
+
+#endif // PLUGIN_HELPERS_H_
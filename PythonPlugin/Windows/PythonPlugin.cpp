@@ -26,6 +26,7 @@ NOTE: Cannot use bool as a return or parameter type for exported functions becau
 
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#include <climits>
 #include <regex>
 #include <string>
 #include <vector>
@@ -33,19 +34,12 @@ NOTE: Cannot use bool as a return or parameter type for exported functions becau
 
 #include "PythonPlugin.h"
 #include "PythonErrorHandling.h"
+#include "PluginHelpers.h"
+#include "PythonThreading.h"
 #ifdef PLUGIN
 #include "..\AGKLibraryCommands.h"
 #endif
 
-// Force use of the release build of python36.dll.
-#ifdef _DEBUG
-#undef _DEBUG
-#include <Python.h>
-#define _DEBUG
-#else
-#include <Python.h>
-#endif
-
 // These need to be stored staticly and should not be changed while Python is initialized.
 wchar_t *m_ProgramName;
 wchar_t *m_PythonHome;
@@ -73,24 +67,6 @@ PyObject *GetPyObject(int handle)
 	return NULL;
 }
 
-// Used to check required handles and report when they are 0.
-#define REQUIRED_HANDLEV(handle)						\
-	if (handle == 0)									\
-	{													\
-		std::string msg = __FUNCTION__;					\
-		msg += ": Given required handle was null.";		\
-		agk::PluginError(msg.c_str());					\
-		return;											\
-	}
-#define REQUIRED_HANDLE(handle)							\
-	if (handle == 0)									\
-	{													\
-		std::string msg = __FUNCTION__;					\
-		msg += ": Given required handle was null.";		\
-		agk::PluginError(msg.c_str());					\
-		return NULL;									\
-	}
-
 int GetHandle(PyObject *object)
 {
 	if (object == NULL)
@@ -121,6 +97,14 @@ void ResetPyObjectHandleList()
 	m_Objects.push_back(Py_None); // Store Py_None as handle 1.
 }
 
+/*
+Swaps the handle list with another one.  Each sub-interpreter has its own handle list.
+*/
+void SwapPyObjectHandleList(std::vector<PyObject *> &objects)
+{
+	m_Objects.swap(objects);
+}
+
 /*
 Converts a wchar_t* to agk:string.
 */
@@ -215,14 +199,72 @@ std::vector<std::string> ParseCSV(char * text)
 	return ParseCSV(csv);
 }
 
+/*
+Returns a pointer to the given range of a memblock or NULL if the memblock does not exist or is too small.
+*/
+unsigned char *GetMemblockRangeEx(int memID, int offset, int size, const char *caller)
+{
+	if (!agk::GetMemblockExists(memID))
+	{
+		std::string msg = caller;
+		msg += ": Memblock does not exist.";
+		agk::PluginError(msg.c_str());
+		return NULL;
+	}
+	int memblockSize = agk::GetMemblockSize(memID);
+	if (offset < 0 || size < 0 || offset > memblockSize || size > memblockSize - offset)
+	{
+		std::string msg = caller;
+		msg += ": Memblock range is out of bounds.";
+		agk::PluginError(msg.c_str());
+		return NULL;
+	}
+	return agk::GetMemblockPtr(memID) + offset;
+}
+
+/*
+Returns a pointer to count items of itemSize bytes in a memblock, or NULL if the count is negative or the range
+doesn't fit.
+*/
+unsigned char *GetMemblockArrayEx(int memID, int offset, Py_ssize_t count, int itemSize, const char *caller)
+{
+	if (count < 0 || (itemSize > 0 && count > INT_MAX / itemSize))
+	{
+		std::string msg = caller;
+		msg += ": Memblock range is out of bounds.";
+		agk::PluginError(msg.c_str());
+		return NULL;
+	}
+	return GetMemblockRangeEx(memID, offset, (int)count * itemSize, caller);
+}
+
+void RegisterBuiltinModule(const char *name, PyObject *(*init)())
+{
+	// The inittab can only be appended to before Python is initialized and keeps its entries after finalizing.
+	static std::vector<std::string> registered;
+	for (const std::string &other : registered)
+	{
+		if (other == name)
+		{
+			return;
+		}
+	}
+	PyImport_AppendInittab(name, init);
+	registered.push_back(name);
+}
+
 /*
 https://docs.python.org/3/c-api/init.html
 */
 void _Py_Initialize()
 {
 	ResetPyObjectHandleList();
+	RegisterMessageQueueModule();
+	RegisterAgkModule();
+	RegisterAgkImportModule();
 	Py_InitializeEx(0);
 	//Py_Initialize();
+	InitThreads();
 }
 
 int _Py_IsInitialized()
@@ -230,8 +272,21 @@ int _Py_IsInitialized()
 	return Py_IsInitialized();
 }
 
+// Defined with the PyDict_Next functions below.
+static void SetDictNextItem(PyObject *key, PyObject *value);
+
 int _Py_Finalize()
 {
+	PyPool_Stop();
+	ShutdownAsyncJobs();
+	ShutdownWatchdog();
+	FinalizeThreads();
+	// Needs the GIL, and the item may belong to a sub-interpreter, so release it before those are destroyed.
+	SetDictNextItem(NULL, NULL);
+	ShutdownInterpreters();
+	PyAsync_Close();
+	PyScheduler_Clear();
+	PyHook_Clear();
 	ResetPyObjectHandleList();
 	FreeWChar(m_ProgramName);
 	FreeWChar(m_PythonHome);
@@ -240,6 +295,7 @@ int _Py_Finalize()
 
 void _Py_SetProgramName(char *name)
 {
+	HOLD_GIL
 	//  The argument should point to a zero-terminated wide character string in static storage whose contents will not change for the duration of the program's execution.
 	if (Py_IsInitialized())
 	{
@@ -256,31 +312,37 @@ void _Py_SetProgramName(char *name)
 
 char *_Py_GetProgramName()
 {
+	HOLD_GIL
 	return CreateString(Py_GetProgramName());
 }
 
 char *_Py_GetPrefix()
 {
+	HOLD_GIL
 	return CreateString(Py_GetPrefix());
 }
 
 char *_Py_GetExecPrefix()
 {
+	HOLD_GIL
 	return CreateString(Py_GetExecPrefix());
 }
 
 char *_Py_GetProgramFullPath()
 {
+	HOLD_GIL
 	return CreateString(Py_GetProgramFullPath());
 }
 
 char *_Py_GetPath()
 {
+	HOLD_GIL
 	return CreateString(Py_GetPath());
 }
 
 void _Py_SetPath(char *path)
 {
+	HOLD_GIL
 	wchar_t *wPath = DecodeString(path);
 	if (wPath != NULL)
 	{
@@ -291,31 +353,37 @@ void _Py_SetPath(char *path)
 
 char *_Py_GetVersion()
 {
+	HOLD_GIL
 	return CreateString(Py_GetVersion());
 }
 
 char *_Py_GetPlatform()
 {
+	HOLD_GIL
 	return CreateString(Py_GetPlatform());
 }
 
 char *_Py_GetCopyright()
 {
+	HOLD_GIL
 	return CreateString(Py_GetCopyright());
 }
 
 char *_Py_GetCompiler()
 {
+	HOLD_GIL
 	return CreateString(Py_GetCompiler());
 }
 
 char *_Py_GetBuildInfo()
 {
+	HOLD_GIL
 	return CreateString(Py_GetBuildInfo());
 }
 
 void _Py_SetPythonHome(char *home)
 {
+	HOLD_GIL
 	if (Py_IsInitialized())
 	{
 		agk::PluginError("Py_SetPythonHome cannot be called while Python is initialized.");
@@ -331,6 +399,7 @@ void _Py_SetPythonHome(char *home)
 
 char *_Py_GetPythonHome()
 {
+	HOLD_GIL
 	return CreateString(Py_GetPythonHome());
 }
 
@@ -339,6 +408,7 @@ Helper functions
 */
 int GetMainModuleDict()
 {
+	HOLD_GIL
 	PyObject *module = PyImport_AddModule("__main__"); // borrowed ref
 	if (module == NULL)
 	{
@@ -383,11 +453,135 @@ int GetMainModuleDict()
 //	Py_DecRef(func);
 //}
 
+/*
+Returns the memblock range for attr_count columns of count floats, or NULL if it would not fit.
+*/
+static float *GetFloatColumns(int memID, int offset, Py_ssize_t count, Py_ssize_t attr_count, const char *caller)
+{
+	if (attr_count > INT_MAX / (Py_ssize_t)sizeof(float))
+	{
+		std::string msg = caller;
+		msg += ": Memblock range is out of bounds.";
+		agk::PluginError(msg.c_str());
+		return NULL;
+	}
+	return (float *)GetMemblockArrayEx(memID, offset, count, (int)(attr_count * sizeof(float)), caller);
+}
+
+/*
+Struct-of-arrays transfers between the attributes of a sequence of objects and a memblock.
+
+The memblock holds one float column per attribute name, starting at offset:
+	[attr0 of item 0..N-1][attr1 of item 0..N-1]...
+so the whole transfer is a single plugin call instead of one call per item per attribute.
+Returns the number of items transferred or -1 on error.
+*/
+int GatherAttrFloats(int hsequence, int hattr_names, int memID, int offset)
+{
+	HOLD_GIL
+	REQUIRED_HANDLE(hsequence)
+	REQUIRED_HANDLE(hattr_names)
+	PyObject *items = PySequence_Fast(GetPyObject(hsequence), "GatherAttrFloats: Expected a sequence of objects.");
+	if (items == NULL)
+	{
+		CheckError();
+		return -1;
+	}
+	PyObject *names = PySequence_Fast(GetPyObject(hattr_names), "GatherAttrFloats: Expected a sequence of attribute names.");
+	if (names == NULL)
+	{
+		Py_DecRef(items);
+		CheckError();
+		return -1;
+	}
+	Py_ssize_t count = PySequence_Fast_GET_SIZE(items);
+	Py_ssize_t attr_count = PySequence_Fast_GET_SIZE(names);
+	int result = (int)count;
+	float *columns = GetFloatColumns(memID, offset, count, attr_count, "GatherAttrFloats");
+	if (columns == NULL)
+	{
+		result = -1;
+	}
+	for (Py_ssize_t index = 0; result != -1 && index < count; index++)
+	{
+		PyObject *item = PySequence_Fast_GET_ITEM(items, index); // borrowed ref
+		for (Py_ssize_t attr = 0; attr < attr_count; attr++)
+		{
+			PyObject *value = PyObject_GetAttr(item, PySequence_Fast_GET_ITEM(names, attr));
+			if (value == NULL)
+			{
+				result = -1;
+				break;
+			}
+			double d = PyFloat_AsDouble(value);
+			Py_DecRef(value);
+			if (d == -1.0 && PyErr_Occurred())
+			{
+				result = -1;
+				break;
+			}
+			columns[attr * count + index] = (float)d;
+		}
+	}
+	Py_DecRef(names);
+	Py_DecRef(items);
+	CheckError();
+	return result;
+}
+
+int ScatterAttrFloats(int hsequence, int hattr_names, int memID, int offset)
+{
+	HOLD_GIL
+	REQUIRED_HANDLE(hsequence)
+	REQUIRED_HANDLE(hattr_names)
+	PyObject *items = PySequence_Fast(GetPyObject(hsequence), "ScatterAttrFloats: Expected a sequence of objects.");
+	if (items == NULL)
+	{
+		CheckError();
+		return -1;
+	}
+	PyObject *names = PySequence_Fast(GetPyObject(hattr_names), "ScatterAttrFloats: Expected a sequence of attribute names.");
+	if (names == NULL)
+	{
+		Py_DecRef(items);
+		CheckError();
+		return -1;
+	}
+	Py_ssize_t count = PySequence_Fast_GET_SIZE(items);
+	Py_ssize_t attr_count = PySequence_Fast_GET_SIZE(names);
+	int result = (int)count;
+	float *columns = GetFloatColumns(memID, offset, count, attr_count, "ScatterAttrFloats");
+	if (columns == NULL)
+	{
+		result = -1;
+	}
+	for (Py_ssize_t index = 0; result != -1 && index < count; index++)
+	{
+		PyObject *item = PySequence_Fast_GET_ITEM(items, index); // borrowed ref
+		for (Py_ssize_t attr = 0; attr < attr_count; attr++)
+		{
+			PyObject *value = PyFloat_FromDouble(columns[attr * count + index]);
+			if (value == NULL || PyObject_SetAttr(item, PySequence_Fast_GET_ITEM(names, attr), value) == -1)
+			{
+				Py_XDECREF(value);
+				result = -1;
+				break;
+			}
+			Py_DecRef(value);
+		}
+	}
+	Py_DecRef(names);
+	Py_DecRef(items);
+	CheckError();
+	return result;
+}
+
 /*
 https://docs.python.org/3/c-api/veryhigh.html
 */
 int _PyRun_SimpleString(char *command)
 {
+	HOLD_GIL
 	int result = PyRun_SimpleString(command);
 	if (result == -1)
 	{
@@ -398,6 +592,7 @@ int _PyRun_SimpleString(char *command)
 
 int _PyRun_SimpleFile(const char *filename)
 {
+	HOLD_GIL
 	// _Py_fopen must be used in order for this to work, not fopen.
 	//if (FILE *fp = fopen(filename, "r"))
 	// Only diference appears to be that _Py_fopen clears HANDLE_FLAG_INHERIT.
@@ -423,6 +618,7 @@ int _PyRun_SimpleFile(const char *filename)
 
 int _PyRun_String(char *script, int hglobals, int hlocals)
 {
+	HOLD_GIL
 	// If globals and/or locals aren't provided, use an empty dict for them.
 	PyObject *globals = (hglobals) ? GetPyObject(hglobals) : PyDict_New();
 	PyObject *locals = (hlocals) ? GetPyObject(hlocals) : PyDict_New();
@@ -442,6 +638,7 @@ int _PyRun_String(char *script, int hglobals, int hlocals)
 
 int _PyRun_File(const char *filename, int hglobals, int hlocals)
 {
+	HOLD_GIL
 	//if (!hglobals)
 	//{
 	//	// If globals aren't provided, use the main module dict.
@@ -477,6 +674,7 @@ https://docs.python.org/3/c-api/refcounting.html
 */
 void _Py_INCREF(int hobject)
 {
+	HOLD_GIL
 	REQUIRED_HANDLEV(hobject)
 	PyObject *object = GetPyObject(hobject);
 	Py_IncRef(object);
@@ -484,12 +682,14 @@ void _Py_INCREF(int hobject)
 
 void _Py_XINCREF(int hobject)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	Py_XINCREF(object);
 }
 
 void _Py_DECREF(int hobject)
 {
+	HOLD_GIL
 	REQUIRED_HANDLEV(hobject)
 	PyObject *object = GetPyObject(hobject);
 	if (object != NULL && object->ob_refcnt == 1)
@@ -502,6 +702,7 @@ void _Py_DECREF(int hobject)
 
 void _Py_XDECREF(int hobject)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	if (object != NULL && object->ob_refcnt == 1)
 	{
@@ -513,6 +714,7 @@ void _Py_XDECREF(int hobject)
 
 void _Py_CLEAR(int hobject)
 {
+	HOLD_GIL
 	// Handles are 1-based!
 	if (hobject > 0 && hobject <= (int)m_Objects.size())
 	{
@@ -527,6 +729,7 @@ https://docs.python.org/3/c-api/structures.html
 */
 char *_Py_TYPE_NAME(int hobject)
 {
+	HOLD_GIL
 	//REQUIRED_HANDLE(hobject)
 	PyObject *object = GetPyObject(hobject);
 	if (object == NULL)
@@ -538,6 +741,7 @@ char *_Py_TYPE_NAME(int hobject)
 
 int _Py_REFCNT(int hobject)
 {
+	HOLD_GIL
 	//REQUIRED_HANDLE(hobject)
 	PyObject *object = GetPyObject(hobject);
 	if (object == NULL)
@@ -549,6 +753,7 @@ int _Py_REFCNT(int hobject)
 
 int _Py_SIZE(int hobject)
 {
+	HOLD_GIL
 	//REQUIRED_HANDLE(hobject)
 	PyObject *object = GetPyObject(hobject);
 	if (object == NULL)
@@ -563,6 +768,7 @@ https://docs.python.org/3/c-api/import.html
 */
 int _PyImport_ImportModule(char *name)
 {
+	HOLD_GIL
 	PyObject *module = PyImport_ImportModule(name);
 	CheckError();
 	return GetHandle(module);
@@ -570,6 +776,7 @@ int _PyImport_ImportModule(char *name)
 
 int _PyImport_ImportModuleEx(const char *name, int hglobals, int hlocals, int hfromlist)
 {
+	HOLD_GIL
 	PyObject *globals = GetPyObject(hglobals);
 	PyObject *locals = GetPyObject(hlocals);
 	PyObject *fromlist = GetPyObject(hfromlist);
@@ -580,6 +787,7 @@ int _PyImport_ImportModuleEx(const char *name, int hglobals, int hlocals, int hf
 
 int _PyImport_Import(int hname)
 {
+	HOLD_GIL
 	REQUIRED_HANDLE(hname)
 	PyObject *name = GetPyObject(hname);
 	PyObject *import = PyImport_Import(name);
@@ -589,6 +797,7 @@ int _PyImport_Import(int hname)
 
 int _PyImport_ImportS(const char *name)
 {
+	HOLD_GIL
 	PyObject *oname = PyUnicode_FromString(name);
 	if (oname == NULL)
 	{
@@ -602,6 +811,7 @@ int _PyImport_ImportS(const char *name)
 
 int _PyImport_ReloadModule(int hhodule)
 {
+	HOLD_GIL
 	PyObject *module = GetPyObject(hhodule);
 	PyObject *reloaded = PyImport_ReloadModule(module);
 	CheckError();
@@ -610,6 +820,7 @@ int _PyImport_ReloadModule(int hhodule)
 
 int _PyImport_AddModule(char * name)
 {
+	HOLD_GIL
 	PyObject *module = PyImport_AddModule(name);
 	CheckError();
 	return GetHandle(module);
@@ -617,6 +828,7 @@ int _PyImport_AddModule(char * name)
 
 int _PyImport_GetModuleDict()
 {
+	HOLD_GIL
 	PyObject *dict = PyImport_GetModuleDict();
 	return GetHandle(dict);
 }
@@ -624,24 +836,28 @@ int _PyImport_GetModuleDict()
 //https://docs.python.org/3/c-api/module.html
 int _PyModule_Check(int hobject)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	return PyModule_Check(object);
 }
 
 int _PyModule_CheckExact(int hobject)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	return PyModule_CheckExact(object);
 }
 
 int _PyModule_New(const char *name)
 {
+	HOLD_GIL
 	PyObject *module = PyModule_New(name);
 	return GetHandle(module);
 }
 
 int _PyModule_GetDict(int hmodule)
 {
+	HOLD_GIL
 	PyObject *module = GetPyObject(hmodule);
 	PyObject *dict = PyModule_GetDict(module);
 	return GetHandle(dict);
@@ -649,6 +865,7 @@ int _PyModule_GetDict(int hmodule)
 
 int _PyModule_GetNameObject(int hmodule)
 {
+	HOLD_GIL
 	PyObject *module = GetPyObject(hmodule);
 	PyObject *object = PyModule_GetNameObject(module);
 	return GetHandle(object);
@@ -656,6 +873,7 @@ int _PyModule_GetNameObject(int hmodule)
 
 char *_PyModule_GetName(int hmodule)
 {
+	HOLD_GIL
 	PyObject *module = GetPyObject(hmodule);
 	return CreateString(PyModule_GetName(module));
 }
@@ -664,6 +882,7 @@ char *_PyModule_GetName(int hmodule)
 // Allowed format chars: szidf()[]{}
 int _Py_BuildValue(const char *format, char *csvtext)
 {
+	HOLD_GIL
 	/*
 	This section is a huge hack!
 	Dynamically build a va_list from parsed csv text based upon the given format.
@@ -720,6 +939,7 @@ int _Py_BuildValue(const char *format, char *csvtext)
 //https://docs.python.org/3/c-api/object.html
 int _PyObject_HasAttr(int hobject, int hattr_name)
 {
+	HOLD_GIL
 	REQUIRED_HANDLE(hobject)
 	PyObject *object = GetPyObject(hobject);
 	PyObject *attr_name = GetPyObject(hattr_name);
@@ -728,6 +948,7 @@ int _PyObject_HasAttr(int hobject, int hattr_name)
 
 int _PyObject_HasAttrString(int hobject, const char *attr_name)
 {
+	HOLD_GIL
 	REQUIRED_HANDLE(hobject)
 	PyObject *object = GetPyObject(hobject);
 	return PyObject_HasAttrString(object, attr_name);
@@ -735,6 +956,7 @@ int _PyObject_HasAttrString(int hobject, const char *attr_name)
 
 int _PyObject_GetAttrHandle(int hobject, int hattr_name)
 {
+	HOLD_GIL
 	REQUIRED_HANDLE(hobject)
 	PyObject *object = GetPyObject(hobject);
 	PyObject *attr_name = GetPyObject(hattr_name);
@@ -743,6 +965,7 @@ int _PyObject_GetAttrHandle(int hobject, int hattr_name)
 
 int _PyObject_GetAttrHandleS(int hobject, const char *attr_name)
 {
+	HOLD_GIL
 	REQUIRED_HANDLE(hobject)
 	PyObject *object = GetPyObject(hobject);
 	return GetHandle(PyObject_GetAttrString(object, attr_name));
@@ -750,6 +973,7 @@ int _PyObject_GetAttrHandleS(int hobject, const char *attr_name)
 
 float _PyObject_GetAttrFloat(int hobject, const char *attr_name)
 {
+	HOLD_GIL
 	REQUIRED_HANDLE(hobject)
 	PyObject *object = GetPyObject(hobject);
 	return (float) PyFloat_AsDouble(PyObject_GetAttrString(object, attr_name));
@@ -757,6 +981,7 @@ float _PyObject_GetAttrFloat(int hobject, const char *attr_name)
 
 int _PyObject_GetAttrInt(int hobject, const char *attr_name)
 {
+	HOLD_GIL
 	REQUIRED_HANDLE(hobject)
 	PyObject *object = GetPyObject(hobject);
 	return PyLong_AsLong(PyObject_GetAttrString(object, attr_name));
@@ -764,6 +989,7 @@ int _PyObject_GetAttrInt(int hobject, const char *attr_name)
 
 const char *_PyObject_GetAttrString(int hobject, const char *attr_name)
 {
+	HOLD_GIL
 	REQUIRED_HANDLE(hobject)
 	PyObject *object = GetPyObject(hobject);
 	return CreateString(PyObject_GetAttrString(object, attr_name));
@@ -771,6 +997,7 @@ const char *_PyObject_GetAttrString(int hobject, const char *attr_name)
 
 int _PyObject_SetAttrHandle(int hobject, int hattr_name, int hvalue)
 {
+	HOLD_GIL
 	REQUIRED_HANDLE(hobject)
 	PyObject *object = GetPyObject(hobject);
 	PyObject *attr_name = GetPyObject(hattr_name);
@@ -780,6 +1007,7 @@ int _PyObject_SetAttrHandle(int hobject, int hattr_name, int hvalue)
 
 int _PyObject_SetAttrHandleS(int hobject, const char *attr_name, int hvalue)
 {
+	HOLD_GIL
 	REQUIRED_HANDLE(hobject)
 	PyObject *object = GetPyObject(hobject);
 	PyObject *value = GetPyObject(hvalue);
@@ -788,6 +1016,7 @@ int _PyObject_SetAttrHandleS(int hobject, const char *attr_name, int hvalue)
 
 int _PyObject_SetAttrFloat(int hobject, const char *attr_name, float value)
 {
+	HOLD_GIL
 	REQUIRED_HANDLE(hobject)
 	PyObject *object = GetPyObject(hobject);
 	PyObject *v = PyFloat_FromDouble(value);
@@ -798,6 +1027,7 @@ int _PyObject_SetAttrFloat(int hobject, const char *attr_name, float value)
 
 int _PyObject_SetAttrInt(int hobject, const char *attr_name, int value)
 {
+	HOLD_GIL
 	REQUIRED_HANDLE(hobject)
 	PyObject *object = GetPyObject(hobject);
 	PyObject *v = PyLong_FromLong(value);
@@ -808,6 +1038,7 @@ int _PyObject_SetAttrInt(int hobject, const char *attr_name, int value)
 
 int _PyObject_SetAttrString(int hobject, const char *attr_name, const char *value)
 {
+	HOLD_GIL
 	REQUIRED_HANDLE(hobject)
 	PyObject *object = GetPyObject(hobject);
 	PyObject *v = PyUnicode_FromString(value);
@@ -818,6 +1049,7 @@ int _PyObject_SetAttrString(int hobject, const char *attr_name, const char *valu
 
 int _PyObject_DelAttr(int hobject, int hattr_name)
 {
+	HOLD_GIL
 	REQUIRED_HANDLE(hobject)
 	PyObject *object = GetPyObject(hobject);
 	PyObject *attr_name = GetPyObject(hattr_name);
@@ -826,6 +1058,7 @@ int _PyObject_DelAttr(int hobject, int hattr_name)
 
 int _PyObject_DelAttrString(int hobject, const char *attr_name)
 {
+	HOLD_GIL
 	REQUIRED_HANDLE(hobject)
 	PyObject *object = GetPyObject(hobject);
 	return PyObject_DelAttrString(object, attr_name);
@@ -833,12 +1066,14 @@ int _PyObject_DelAttrString(int hobject, const char *attr_name)
 
 int _PyObject_ReprObj(int hobject)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	return GetHandle(PyObject_Repr(object));
 }
 
 const char *_PyObject_Repr(int hobject)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	PyObject *repr = PyObject_Repr(object);
 	if (repr == NULL)
@@ -852,12 +1087,14 @@ const char *_PyObject_Repr(int hobject)
 
 int _PyObject_StrObj(int hobject)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	return GetHandle(PyObject_Str(object));
 }
 
 const char *_PyObject_Str(int hobject)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	PyObject *str = PyObject_Str(object);
 	if (str == NULL)
@@ -871,12 +1108,14 @@ const char *_PyObject_Str(int hobject)
 
 int _PyCallable_Check(int hobject)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	return PyCallable_Check(object);
 }
 
 int _PyObject_Call(int hcallable_object, int hargs, int hkw)
 {
+	HOLD_GIL
 	REQUIRED_HANDLE(hcallable_object)
 	// If no named arguments are needed, kw may be NULL. args must not be NULL, use an empty tuple if no arguments are needed.
 	PyObject *callable_object = GetPyObject(hcallable_object);
@@ -894,6 +1133,7 @@ int _PyObject_Call(int hcallable_object, int hargs, int hkw)
 
 int _PyObject_Length(int hobject)
 {
+	HOLD_GIL
 	REQUIRED_HANDLE(hobject)
 	PyObject *object = GetPyObject(hobject);
 	return PyObject_Length(object);
@@ -901,6 +1141,7 @@ int _PyObject_Length(int hobject)
 
 int _PyObject_GetItem(int hobject, int hkey)
 {
+	HOLD_GIL
 	REQUIRED_HANDLE(hobject)
 	PyObject *object = GetPyObject(hobject);
 	PyObject *key = GetPyObject(hkey);
@@ -909,6 +1150,7 @@ int _PyObject_GetItem(int hobject, int hkey)
 
 int _PyObject_SetItem(int hobject, int hkey, int hvalue)
 {
+	HOLD_GIL
 	REQUIRED_HANDLE(hobject)
 	PyObject *object = GetPyObject(hobject);
 	PyObject *key = GetPyObject(hkey);
@@ -918,6 +1160,7 @@ int _PyObject_SetItem(int hobject, int hkey, int hvalue)
 
 int _PyObject_DelItem(int hobject, int hkey)
 {
+	HOLD_GIL
 	REQUIRED_HANDLE(hobject)
 	PyObject *object = GetPyObject(hobject);
 	PyObject *key = GetPyObject(hkey);
@@ -926,34 +1169,195 @@ int _PyObject_DelItem(int hobject, int hkey)
 
 int _PyObject_GetIter(int hobject)
 {
+	HOLD_GIL
 	REQUIRED_HANDLE(hobject)
 	PyObject *object = GetPyObject(hobject);
 	return GetHandle(PyObject_GetIter(object));
 }
 
+/*
+https://docs.python.org/3/c-api/iter.html
+
+The batch functions pull up to maxCount items per call so a large generator can be drained with one call per batch.
+They return the number of items read, which is less than maxCount only once the iterator is exhausted, or -1 on error.
+*/
+int _PyIter_Check(int hobject)
+{
+	HOLD_GIL
+	PyObject *object = GetPyObject(hobject);
+	return (object != NULL) && PyIter_Check(object);
+}
+
+// Returns the iterator for the handle, or NULL after reporting a TypeError if the object is not an iterator.
+static PyObject *GetIterator(int hiterator, const char *caller)
+{
+	PyObject *iterator = GetPyObject(hiterator);
+	if (iterator == NULL)
+	{
+		return NULL;
+	}
+	if (!PyIter_Check(iterator))
+	{
+		PyErr_Format(PyExc_TypeError, "%s: '%.200s' object is not an iterator.", caller, Py_TYPE(iterator)->tp_name);
+		CheckError();
+		return NULL;
+	}
+	return iterator;
+}
+
+// Returns 0 when the iterator is exhausted.
+int _PyIter_Next(int hiterator)
+{
+	HOLD_GIL
+	REQUIRED_HANDLE(hiterator)
+	PyObject *iterator = GetIterator(hiterator, "PyIter_Next");
+	if (iterator == NULL)
+	{
+		return 0;
+	}
+	PyObject *item = PyIter_Next(iterator);
+	CheckError();
+	return GetHandle(item);
+}
+
+int _PyIter_NextBatch(int hiterator, int hlist, int maxCount)
+{
+	HOLD_GIL
+	REQUIRED_HANDLE(hiterator)
+	REQUIRED_HANDLE(hlist)
+	PyObject *iterator = GetIterator(hiterator, "PyIter_NextBatch");
+	if (iterator == NULL)
+	{
+		return -1;
+	}
+	PyObject *list = GetPyObject(hlist);
+	int count = 0;
+	while (count < maxCount)
+	{
+		PyObject *item = PyIter_Next(iterator);
+		if (item == NULL)
+		{
+			break;
+		}
+		int result = PyList_Append(list, item);
+		Py_DecRef(item);
+		if (result == -1)
+		{
+			break;
+		}
+		count++;
+	}
+	if (PyErr_Occurred())
+	{
+		CheckError();
+		return -1;
+	}
+	return count;
+}
+
+int _PyIter_NextFloats(int hiterator, int memID, int offset, int maxCount)
+{
+	HOLD_GIL
+	REQUIRED_HANDLE(hiterator)
+	PyObject *iterator = GetIterator(hiterator, "PyIter_NextFloats");
+	if (iterator == NULL)
+	{
+		return -1;
+	}
+	float *values = (float *)GetMemblockArray(memID, offset, maxCount, (int)sizeof(float));
+	if (values == NULL)
+	{
+		return -1;
+	}
+	int count = 0;
+	while (count < maxCount)
+	{
+		PyObject *item = PyIter_Next(iterator);
+		if (item == NULL)
+		{
+			break;
+		}
+		double value = PyFloat_AsDouble(item);
+		Py_DecRef(item);
+		if (value == -1.0 && PyErr_Occurred())
+		{
+			break;
+		}
+		values[count++] = (float)value;
+	}
+	if (PyErr_Occurred())
+	{
+		CheckError();
+		return -1;
+	}
+	return count;
+}
+
+int _PyIter_NextInts(int hiterator, int memID, int offset, int maxCount)
+{
+	HOLD_GIL
+	REQUIRED_HANDLE(hiterator)
+	PyObject *iterator = GetIterator(hiterator, "PyIter_NextInts");
+	if (iterator == NULL)
+	{
+		return -1;
+	}
+	int *values = (int *)GetMemblockArray(memID, offset, maxCount, (int)sizeof(int));
+	if (values == NULL)
+	{
+		return -1;
+	}
+	int count = 0;
+	while (count < maxCount)
+	{
+		PyObject *item = PyIter_Next(iterator);
+		if (item == NULL)
+		{
+			break;
+		}
+		long value = PyLong_AsLong(item);
+		Py_DecRef(item);
+		if (value == -1 && PyErr_Occurred())
+		{
+			break;
+		}
+		values[count++] = (int)value;
+	}
+	if (PyErr_Occurred())
+	{
+		CheckError();
+		return -1;
+	}
+	return count;
+}
+
 /*
 https://docs.python.org/3/c-api/long.html
 */
 int _PyLong_Check(int hobject)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	return PyLong_Check(object);
 }
 
 int _PyLong_CheckExact(int hobject)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	return PyLong_CheckExact(object);
 }
 
 int _PyLong_FromLong(int value)
 {
+	HOLD_GIL
 	PyObject *object = PyLong_FromLong(value);
 	return GetHandle(object);
 }
 
 int _PyLong_AsLong(int hlong)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hlong);
 	return PyLong_AsLong(object);
 }
@@ -963,24 +1367,28 @@ https://docs.python.org/3/c-api/float.html
 */
 int _PyFloat_Check(int hobject)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	return PyFloat_Check(object);
 }
 
 int _PyFloat_CheckExact(int hobject)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	return PyFloat_CheckExact(object);
 }
 
 int _PyFloat_FromDouble(float value)
 {
+	HOLD_GIL
 	PyObject *object = PyFloat_FromDouble(value);
 	return GetHandle(object);
 }
 
 float _PyFloat_AsDouble(int hdouble)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hdouble);
 	return (float)PyFloat_AsDouble(object);
 }
@@ -988,18 +1396,21 @@ float _PyFloat_AsDouble(int hdouble)
 //https://docs.python.org/3/c-api/unicode.html
 int _PyUnicode_Check(int hobject)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	return PyUnicode_Check(object);
 }
 
 int _PyUnicode_CheckExact(int hobject)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	return PyUnicode_CheckExact(object);
 }
 
 int _PyUnicode_FromString(const char *value)
 {
+	HOLD_GIL
 	PyObject *object = PyUnicode_FromString(value);
 	return GetHandle(object);
 }
@@ -1007,6 +1418,7 @@ int _PyUnicode_FromString(const char *value)
 // Note: Can't name this _PyUnicode_AsString because that's a macro that exists in the Python header.
 const char *_PyUnicode_AsStringPL(int hunicode)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hunicode);
 	return CreateString(object);
 }
@@ -1016,18 +1428,21 @@ https://docs.python.org/3/c-api/tuple.html
 */
 int _PyTuple_Check(int hobject)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	return PyTuple_Check(object);
 }
 
 int _PyTuple_CheckExact(int hobject)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	return PyTuple_CheckExact(object);
 }
 
 int _PyTuple_New(int size)
 {
+	HOLD_GIL
 	return GetHandle(PyTuple_New(size));
 }
 
@@ -1035,42 +1450,49 @@ int _PyTuple_New(int size)
 
 int _PyTuple_Size(int hobject)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	return PyTuple_Size(object);
 }
 
 int _PyTuple_GetItemHandle(int hobject, int pos)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	return GetHandle(PyTuple_GetItem(object, pos));
 }
 
 float _PyTuple_GetItemFloat(int hobject, int pos)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	return (float) PyFloat_AsDouble(PyTuple_GetItem(object, pos));
 }
 
 int _PyTuple_GetItemInt(int hobject, int pos)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	return PyLong_AsLong(PyTuple_GetItem(object, pos));
 }
 
 const char *_PyTuple_GetItemString(int hobject, int pos)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	return CreateString(PyTuple_GetItem(object, pos));
 }
 
 int _PyTuple_GetSlice(int hobject, int low, int high)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	return GetHandle(PyTuple_GetSlice(object, low, high));
 }
 
 int _PyTuple_SetItemHandle(int hobject, int pos, int hvalue)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	PyObject *value = GetPyObject(hvalue);
 	return PyTuple_SetItem(object, pos, value);
@@ -1078,6 +1500,7 @@ int _PyTuple_SetItemHandle(int hobject, int pos, int hvalue)
 
 int _PyTuple_SetItemFloat(int hobject, int pos, float value)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	// PyTuple_SetItem steals the value reference!
 	return PyTuple_SetItem(object, pos, PyFloat_FromDouble(value));
@@ -1085,6 +1508,7 @@ int _PyTuple_SetItemFloat(int hobject, int pos, float value)
 
 int _PyTuple_SetItemInt(int hobject, int pos, int value)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	// PyTuple_SetItem steals the value reference!
 	return PyTuple_SetItem(object, pos, PyLong_FromLong(value));
@@ -1092,6 +1516,7 @@ int _PyTuple_SetItemInt(int hobject, int pos, int value)
 
 int _PyTuple_SetItemString(int hobject, int pos, const char *value)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	// PyTuple_SetItem steals the value reference!
 	return PyTuple_SetItem(object, pos, PyUnicode_FromString(value));
@@ -1102,53 +1527,62 @@ https://docs.python.org/3/c-api/list.html
 */
 int _PyList_Check(int hobject)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	return PyList_Check(object);
 }
 
 int _PyList_CheckExact(int hobject)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	return PyList_CheckExact(object);
 }
 
 int _PyList_New(int size)
 {
+	HOLD_GIL
 	return GetHandle(PyList_New(size));
 }
 
 int _PyList_Size(int hlist)
 {
+	HOLD_GIL
 	PyObject *list = GetPyObject(hlist);
 	return PyList_Size(list);
 }
 
 int _PyList_GetItemHandle(int hlist, int index)
 {
+	HOLD_GIL
 	PyObject *list = GetPyObject(hlist);
 	return GetHandle(PyList_GetItem(list, index));
 }
 
 float _PyList_GetItemFloat(int hlist, int index)
 {
+	HOLD_GIL
 	PyObject *list = GetPyObject(hlist);
 	return (float)PyFloat_AsDouble(PyList_GetItem(list, index));
 }
 
 int _PyList_GetItemInt(int hlist, int index)
 {
+	HOLD_GIL
 	PyObject *list = GetPyObject(hlist);
 	return PyLong_AsLong(PyList_GetItem(list, index));
 }
 
 const char *_PyList_GetItemString(int hlist, int index)
 {
+	HOLD_GIL
 	PyObject *list = GetPyObject(hlist);
 	return CreateString(PyList_GetItem(list, index));
 }
 
 int _PyList_SetItemHandle(int hlist, int index, int hitem)
 {
+	HOLD_GIL
 	PyObject *list = GetPyObject(hlist);
 	PyObject *item = GetPyObject(hitem);
 	return PyList_SetItem(list, index, item);
@@ -1156,6 +1590,7 @@ int _PyList_SetItemHandle(int hlist, int index, int hitem)
 
 int _PyList_SetItemFloat(int hlist, int index, float value)
 {
+	HOLD_GIL
 	PyObject *list = GetPyObject(hlist);
 	// PyList_SetItem steals the value reference!
 	return PyList_SetItem(list, index, PyFloat_FromDouble(value));
@@ -1163,6 +1598,7 @@ int _PyList_SetItemFloat(int hlist, int index, float value)
 
 int _PyList_SetItemInt(int hlist, int index, int value)
 {
+	HOLD_GIL
 	PyObject *list = GetPyObject(hlist);
 	// PyList_SetItem steals the value reference!
 	return PyList_SetItem(list, index, PyLong_FromLong(value));
@@ -1170,6 +1606,7 @@ int _PyList_SetItemInt(int hlist, int index, int value)
 
 int _PyList_SetItemString(int hlist, int index, const char *value)
 {
+	HOLD_GIL
 	PyObject *list = GetPyObject(hlist);
 	// PyList_SetItem steals the value reference!
 	return PyList_SetItem(list, index, PyUnicode_FromString(value));
@@ -1177,6 +1614,7 @@ int _PyList_SetItemString(int hlist, int index, const char *value)
 
 int _PyList_InsertHandle(int hlist, int index, int hitem)
 {
+	HOLD_GIL
 	PyObject *list = GetPyObject(hlist);
 	PyObject *item = GetPyObject(hitem);
 	return PyList_Insert(list, index, item);
@@ -1184,6 +1622,7 @@ int _PyList_InsertHandle(int hlist, int index, int hitem)
 
 int _PyList_InsertFloat(int hlist, int index, float value)
 {
+	HOLD_GIL
 	PyObject *list = GetPyObject(hlist);
 	PyObject *v = PyFloat_FromDouble(value);
 	int result = PyList_Insert(list, index, v);
@@ -1193,6 +1632,7 @@ int _PyList_InsertFloat(int hlist, int index, float value)
 
 int _PyList_InsertInt(int hlist, int index, int value)
 {
+	HOLD_GIL
 	PyObject *list = GetPyObject(hlist);
 	PyObject *v = PyLong_FromLong(value);
 	int result = PyList_Insert(list, index, v);
@@ -1202,6 +1642,7 @@ int _PyList_InsertInt(int hlist, int index, int value)
 
 int _PyList_InsertString(int hlist, int index, const char *value)
 {
+	HOLD_GIL
 	PyObject *list = GetPyObject(hlist);
 	PyObject *v = PyUnicode_FromString(value);
 	int result = PyList_Insert(list, index, v);
@@ -1211,6 +1652,7 @@ int _PyList_InsertString(int hlist, int index, const char *value)
 
 int _PyList_AppendHandle(int hlist, int hitem)
 {
+	HOLD_GIL
 	PyObject *list = GetPyObject(hlist);
 	PyObject *item = GetPyObject(hitem);
 	return PyList_Append(list, item);
@@ -1218,6 +1660,7 @@ int _PyList_AppendHandle(int hlist, int hitem)
 
 int _PyList_AppendFloat(int hlist, float value)
 {
+	HOLD_GIL
 	PyObject *list = GetPyObject(hlist);
 	PyObject *v = PyFloat_FromDouble(value);
 	int result = PyList_Append(list, v);
@@ -1227,6 +1670,7 @@ int _PyList_AppendFloat(int hlist, float value)
 
 int _PyList_AppendInt(int hlist, int value)
 {
+	HOLD_GIL
 	PyObject *list = GetPyObject(hlist);
 	PyObject *v = PyLong_FromLong(value);
 	int result = PyList_Append(list, v);
@@ -1236,6 +1680,7 @@ int _PyList_AppendInt(int hlist, int value)
 
 int _PyList_AppendString(int hlist, const char *value)
 {
+	HOLD_GIL
 	PyObject *list = GetPyObject(hlist);
 	PyObject *v = PyUnicode_FromString(value);
 	int result = PyList_Append(list, v);
@@ -1245,12 +1690,14 @@ int _PyList_AppendString(int hlist, const char *value)
 
 int _PyList_GetSlice(int hlist, int low, int high)
 {
+	HOLD_GIL
 	PyObject *list = GetPyObject(hlist);
 	return GetHandle(PyList_GetSlice(list, low, high));
 }
 
 int _PyList_SetSlice(int hlist, int low, int high, int hitemlist)
 {
+	HOLD_GIL
 	PyObject *list = GetPyObject(hlist);
 	PyObject *itemlist = GetPyObject(hitemlist);
 	return PyList_SetSlice(list, low, high, itemlist);
@@ -1258,18 +1705,21 @@ int _PyList_SetSlice(int hlist, int low, int high, int hitemlist)
 
 int _PyList_Sort(int hlist)
 {
+	HOLD_GIL
 	PyObject *list = GetPyObject(hlist);
 	return PyList_Sort(list);
 }
 
 int _PyList_Reverse(int hlist)
 {
+	HOLD_GIL
 	PyObject *list = GetPyObject(hlist);
 	return PyList_Reverse(list);
 }
 
 int _PyList_AsTuple(int hlist)
 {
+	HOLD_GIL
 	PyObject *list = GetPyObject(hlist);
 	return GetHandle(PyList_AsTuple(list));
 }
@@ -1279,23 +1729,27 @@ https://docs.python.org/3/c-api/dict.html
 */
 int _PyDict_Check(int hobject)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	return PyDict_Check(object);
 }
 
 int _PyDict_CheckExact(int hobject)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	return PyDict_CheckExact(object);
 }
 
 int _PyDict_New()
 {
+	HOLD_GIL
 	return GetHandle(PyDict_New());
 }
 
 void _PyDict_Clear(int hdict)
 {
+	HOLD_GIL
 	PyObject *dict = GetPyObject(hdict);
 	PyDict_Clear(dict);
 }
@@ -1303,6 +1757,7 @@ void _PyDict_Clear(int hdict)
 // Note: Can't name this _PyDict_Contains because that's a macro that exists in the Python header.
 int _PyDict_ContainsKey(int hdict, int hkey)
 {
+	HOLD_GIL
 	PyObject *dict = GetPyObject(hdict);
 	PyObject *key = GetPyObject(hkey);
 	return PyDict_Contains(dict, key);
@@ -1310,6 +1765,7 @@ int _PyDict_ContainsKey(int hdict, int hkey)
 
 int _PyDict_ContainsKeyS(int hdict, const char *key)
 {
+	HOLD_GIL
 	PyObject *dict = GetPyObject(hdict);
 	PyObject *k = PyUnicode_FromString(key);
 	int result = PyDict_Contains(dict, k);
@@ -1319,12 +1775,14 @@ int _PyDict_ContainsKeyS(int hdict, const char *key)
 
 int _PyDict_Copy(int hdict)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hdict);
 	return GetHandle(PyDict_Copy(object));
 }
 
 int _PyDict_SetItemHandle(int hdict, int hkey, int hvalue)
 {
+	HOLD_GIL
 	PyObject *dict = GetPyObject(hdict);
 	PyObject *key = GetPyObject(hkey);
 	PyObject *value = GetPyObject(hvalue);
@@ -1333,6 +1791,7 @@ int _PyDict_SetItemHandle(int hdict, int hkey, int hvalue)
 
 int _PyDict_SetItemHandleS(int hdict, const char *key, int hvalue)
 {
+	HOLD_GIL
 	PyObject *dict = GetPyObject(hdict);
 	PyObject *value = GetPyObject(hvalue);
 	return PyDict_SetItemString(dict, key, value);
@@ -1340,6 +1799,7 @@ int _PyDict_SetItemHandleS(int hdict, const char *key, int hvalue)
 
 int _PyDict_SetItemFloat(int hdict, const char *key, float value)
 {
+	HOLD_GIL
 	PyObject *dict = GetPyObject(hdict);
 	PyObject *v = PyFloat_FromDouble(value);
 	int result = PyDict_SetItemString(dict, key, v);
@@ -1349,6 +1809,7 @@ int _PyDict_SetItemFloat(int hdict, const char *key, float value)
 
 int _PyDict_SetItemInt(int hdict, const char *key, int value)
 {
+	HOLD_GIL
 	PyObject *dict = GetPyObject(hdict);
 	PyObject *v = PyLong_FromLong(value);
 	int result = PyDict_SetItemString(dict, key, v);
@@ -1358,6 +1819,7 @@ int _PyDict_SetItemInt(int hdict, const char *key, int value)
 
 int _PyDict_SetItemString(int hdict, const char *key, const char *value)
 {
+	HOLD_GIL
 	PyObject *dict = GetPyObject(hdict);
 	PyObject *v = PyUnicode_FromString(value);
 	int result = PyDict_SetItemString(dict, key, v);
@@ -1367,6 +1829,7 @@ int _PyDict_SetItemString(int hdict, const char *key, const char *value)
 
 int _PyDict_DelItem(int hdict, int hkey)
 {
+	HOLD_GIL
 	PyObject *dict = GetPyObject(hdict);
 	PyObject *key = GetPyObject(hkey);
 	return PyDict_DelItem(dict, key);
@@ -1374,6 +1837,7 @@ int _PyDict_DelItem(int hdict, int hkey)
 
 int _PyDict_DelItemString(int hdict, const char *key)
 {
+	HOLD_GIL
 	PyObject *dict = GetPyObject(hdict);
 	return PyDict_DelItemString(dict, key);
 }
@@ -1381,6 +1845,7 @@ int _PyDict_DelItemString(int hdict, const char *key)
 // Borrowed ref
 int _PyDict_GetItemHandle(int hdict, int hkey)
 {
+	HOLD_GIL
 	PyObject *dict = GetPyObject(hdict);
 	PyObject *key = GetPyObject(hkey);
 	return GetHandle(PyDict_GetItem(dict, key));
@@ -1389,12 +1854,14 @@ int _PyDict_GetItemHandle(int hdict, int hkey)
 // Borrowed ref
 int _PyDict_GetItemHandleS(int hdict, const char *key)
 {
+	HOLD_GIL
 	PyObject *dict = GetPyObject(hdict);
 	return GetHandle(PyDict_GetItemString(dict, key));
 }
 
 float _PyDict_GetItemFloat(int hdict, const char *key)
 {
+	HOLD_GIL
 	PyObject *dict = GetPyObject(hdict);
 	PyObject *item = PyDict_GetItemString(dict, key);
 	if (item == NULL)
@@ -1406,6 +1873,7 @@ float _PyDict_GetItemFloat(int hdict, const char *key)
 
 int _PyDict_GetItemInt(int hdict, const char *key)
 {
+	HOLD_GIL
 	PyObject *dict = GetPyObject(hdict);
 	PyObject *item = PyDict_GetItemString(dict, key);
 	if (item == NULL)
@@ -1417,6 +1885,7 @@ int _PyDict_GetItemInt(int hdict, const char *key)
 
 const char *_PyDict_GetItemString(int hdict, const char *key)
 {
+	HOLD_GIL
 	PyObject *dict = GetPyObject(hdict);
 	PyObject *item = PyDict_GetItemString(dict, key);
 	if (item == NULL)
@@ -1430,6 +1899,7 @@ const char *_PyDict_GetItemString(int hdict, const char *key)
 
 int _PyDict_SetDefault(int hdict, int hkey, int hdefault)
 {
+	HOLD_GIL
 	PyObject *dict = GetPyObject(hdict);
 	PyObject *key = GetPyObject(hkey);
 	PyObject *default = GetPyObject(hdefault);
@@ -1438,30 +1908,35 @@ int _PyDict_SetDefault(int hdict, int hkey, int hdefault)
 
 int _PyDict_Items(int hdict)
 {
+	HOLD_GIL
 	PyObject *dict = GetPyObject(hdict);
 	return GetHandle(PyDict_Items(dict));
 }
 
 int _PyDict_Keys(int hdict)
 {
+	HOLD_GIL
 	PyObject *dict = GetPyObject(hdict);
 	return GetHandle(PyDict_Keys(dict));
 }
 
 int _PyDict_Values(int hdict)
 {
+	HOLD_GIL
 	PyObject *dict = GetPyObject(hdict);
 	return GetHandle(PyDict_Values(dict));
 }
 
 int _PyDict_Size(int hdict)
 {
+	HOLD_GIL
 	PyObject *dict = GetPyObject(hdict);
 	return PyDict_Size(dict);
 }
 
 int _PyDict_Merge(int hdicta, int hdictb, int override)
 {
+	HOLD_GIL
 	PyObject *dicta = GetPyObject(hdicta);
 	PyObject *dictb = GetPyObject(hdictb);
 	return PyDict_Merge(dicta, dictb, override);
@@ -1469,64 +1944,309 @@ int _PyDict_Merge(int hdicta, int hdictb, int override)
 
 int _PyDict_Update(int hdicta, int hdictb)
 {
+	HOLD_GIL
 	PyObject *dicta = GetPyObject(hdicta);
 	PyObject *dictb = GetPyObject(hdictb);
 	return PyDict_Update(dicta, dictb);
 }
 
+/*
+Positional dict traversal built on PyDict_Next.  Unlike PyDict_Items/Keys/Values, this doesn't create any lists or tuples.
+
+Start with pos = 0 and keep calling PyDict_Next with the returned position until it returns 0.
+After each step the current key and value are available through the PyDict_NextKey* and PyDict_NextValue* functions.
+The dict must not be changed while it is being traversed.  The current key and value are held as new references, so
+they stay valid even if it is.
+*/
+PyObject *m_DictNextKey;	// new ref
+PyObject *m_DictNextValue;	// new ref
+
+static void SetDictNextItem(PyObject *key, PyObject *value)
+{
+	Py_XINCREF(key);
+	Py_XINCREF(value);
+	Py_XDECREF(m_DictNextKey);
+	Py_XDECREF(m_DictNextValue);
+	m_DictNextKey = key;
+	m_DictNextValue = value;
+}
+
+// Note: Can't name this _PyDict_Next because that's a function that exists in the Python header.
+int _PyDict_NextItem(int hdict, int pos)
+{
+	HOLD_GIL
+	REQUIRED_HANDLE(hdict)
+	PyObject *dict = GetPyObject(hdict);
+	Py_ssize_t ppos = pos;
+	PyObject *key, *value; // borrowed refs
+	if (dict != NULL && PyDict_Next(dict, &ppos, &key, &value))
+	{
+		SetDictNextItem(key, value);
+		return (int)ppos;
+	}
+	SetDictNextItem(NULL, NULL);
+	return 0;
+}
+
+// Borrowed ref
+int _PyDict_NextKeyHandle()
+{
+	HOLD_GIL
+	return GetHandle(m_DictNextKey);
+}
+
+const char *_PyDict_NextKeyString()
+{
+	HOLD_GIL
+	if (m_DictNextKey == NULL || !PyUnicode_Check(m_DictNextKey))
+	{
+		return CreateString((const char *)NULL);
+	}
+	return CreateString(m_DictNextKey);
+}
+
+// Borrowed ref
+int _PyDict_NextValueHandle()
+{
+	HOLD_GIL
+	return GetHandle(m_DictNextValue);
+}
+
+float _PyDict_NextValueFloat()
+{
+	HOLD_GIL
+	if (m_DictNextValue == NULL)
+	{
+		return 0.0;
+	}
+	return (float)PyFloat_AsDouble(m_DictNextValue);
+}
+
+int _PyDict_NextValueInt()
+{
+	HOLD_GIL
+	if (m_DictNextValue == NULL)
+	{
+		return 0;
+	}
+	return PyLong_AsLong(m_DictNextValue);
+}
+
+const char *_PyDict_NextValueString()
+{
+	HOLD_GIL
+	if (m_DictNextValue == NULL || !PyUnicode_Check(m_DictNextValue))
+	{
+		return CreateString((const char *)NULL);
+	}
+	return CreateString(m_DictNextValue);
+}
+
+/*
+Bulk dict columns.  These walk the whole dict with PyDict_Next and write its keys or values in dict order, so the
+columns from separate calls line up as long as the dict is not changed in between.
+The memblock versions return the number of items written or -1 on error.
+The string versions join the items with the given delimiter for use with SplitString or GetStringToken.
+*/
+typedef bool(*DictColumnWriter)(PyObject *item, unsigned char *dest);
+
+static bool WriteFloatColumnItem(PyObject *item, unsigned char *dest)
+{
+	double value = PyFloat_AsDouble(item);
+	if (value == -1.0 && PyErr_Occurred())
+	{
+		return false;
+	}
+	*(float *)dest = (float)value;
+	return true;
+}
+
+static bool WriteIntColumnItem(PyObject *item, unsigned char *dest)
+{
+	long value = PyLong_AsLong(item);
+	if (value == -1 && PyErr_Occurred())
+	{
+		return false;
+	}
+	*(int *)dest = (int)value;
+	return true;
+}
+
+static int WriteDictColumn(int hdict, bool keys, int memID, int offset, DictColumnWriter writer, const char *caller)
+{
+	PyObject *dict = GetPyObject(hdict);
+	if (dict == NULL || !PyDict_Check(dict))
+	{
+		std::string msg = caller;
+		msg += ": Given handle is not a dict.";
+		agk::PluginError(msg.c_str());
+		return -1;
+	}
+	Py_ssize_t count = PyDict_Size(dict);
+	unsigned char *dest = GetMemblockArrayEx(memID, offset, count, 4, caller);
+	if (dest == NULL)
+	{
+		return -1;
+	}
+	Py_ssize_t pos = 0;
+	Py_ssize_t written = 0;
+	PyObject *key, *value; // borrowed refs
+	// The writers can run __float__ or __index__, which can change the dict, so never write more than count items.
+	while (written < count && PyDict_Next(dict, &pos, &key, &value))
+	{
+		PyObject *item = keys ? key : value;
+		Py_INCREF(item);
+		bool ok = writer(item, dest);
+		Py_DECREF(item);
+		if (!ok)
+		{
+			CheckError();
+			return -1;
+		}
+		dest += 4;
+		written++;
+	}
+	if (written != count || PyDict_Size(dict) != count)
+	{
+		std::string msg = caller;
+		msg += ": The dict changed while it was being read.";
+		agk::PluginError(msg.c_str());
+		return -1;
+	}
+	return (int)count;
+}
+
+static char *JoinDictColumn(int hdict, bool keys, const char *delimiter, const char *caller)
+{
+	PyObject *dict = GetPyObject(hdict);
+	if (dict == NULL || !PyDict_Check(dict))
+	{
+		std::string msg = caller;
+		msg += ": Given handle is not a dict.";
+		agk::PluginError(msg.c_str());
+		return CreateString((const char *)NULL);
+	}
+	std::string text;
+	Py_ssize_t pos = 0;
+	PyObject *key, *value; // borrowed refs
+	bool first = true;
+	while (PyDict_Next(dict, &pos, &key, &value))
+	{
+		PyObject *item = keys ? key : value;
+		if (!first)
+		{
+			text += delimiter;
+		}
+		first = false;
+		// PyObject_Str can run code that removes the item from the dict.
+		Py_INCREF(item);
+		PyObject *str = (PyUnicode_Check(item)) ? (Py_INCREF(item), item) : PyObject_Str(item);
+		Py_DECREF(item);
+		const char *utf8 = (str) ? _PyUnicode_AsString(str) : NULL;
+		if (utf8 == NULL)
+		{
+			Py_XDECREF(str);
+			CheckError();
+			return CreateString((const char *)NULL);
+		}
+		text += utf8;
+		Py_DecRef(str);
+	}
+	return CreateString(text.c_str());
+}
+
+int _PyDict_KeysToInts(int hdict, int memID, int offset)
+{
+	HOLD_GIL
+	return WriteDictColumn(hdict, true, memID, offset, WriteIntColumnItem, __FUNCTION__);
+}
+
+const char *_PyDict_KeysToString(int hdict, const char *delimiter)
+{
+	HOLD_GIL
+	return JoinDictColumn(hdict, true, delimiter, __FUNCTION__);
+}
+
+int _PyDict_ValuesToFloats(int hdict, int memID, int offset)
+{
+	HOLD_GIL
+	return WriteDictColumn(hdict, false, memID, offset, WriteFloatColumnItem, __FUNCTION__);
+}
+
+int _PyDict_ValuesToInts(int hdict, int memID, int offset)
+{
+	HOLD_GIL
+	return WriteDictColumn(hdict, false, memID, offset, WriteIntColumnItem, __FUNCTION__);
+}
+
+const char *_PyDict_ValuesToString(int hdict, const char *delimiter)
+{
+	HOLD_GIL
+	return JoinDictColumn(hdict, false, delimiter, __FUNCTION__);
+}
+
 /*
 https://docs.python.org/3/c-api/set.html
 */
 int _PySet_Check(int hobject)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	return PySet_Check(object);
 }
 
 int _PyFrozenSet_Check(int hobject)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	return PyFrozenSet_Check(object);
 }
 
 int _PyAnySet_Check(int hobject)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	return PyAnySet_Check(object);
 }
 
 int _PyAnySet_CheckExact(int hobject)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	return PyAnySet_CheckExact(object);
 }
 
 int _PyFrozenSet_CheckExact(int hobject)
 {
+	HOLD_GIL
 	PyObject *object = GetPyObject(hobject);
 	return PyFrozenSet_CheckExact(object);
 }
 
 int _PySet_New(int hiterable)
 {
+	HOLD_GIL
 	PyObject *iterable = GetPyObject(hiterable);
 	return GetHandle(PySet_New(iterable));
 }
 
 int _PyFrozenSet_New(int hiterable)
 {
+	HOLD_GIL
 	PyObject *iterable = GetPyObject(hiterable);
 	return GetHandle(PyFrozenSet_New(iterable));
 }
 
 int _PySet_Size(int hset)
 {
+	HOLD_GIL
 	PyObject *set = GetPyObject(hset);
 	return PySet_Size(set);
 }
 
 int _PySet_Contains(int hset, int hkey)
 {
+	HOLD_GIL
 	PyObject *set = GetPyObject(hset);
 	PyObject *key = GetPyObject(hkey);
 	return PySet_Contains(set, key);
@@ -1534,6 +2254,7 @@ int _PySet_Contains(int hset, int hkey)
 
 int _PySet_Add(int hset, int hkey)
 {
+	HOLD_GIL
 	PyObject *set = GetPyObject(hset);
 	PyObject *key = GetPyObject(hkey);
 	return PySet_Add(set, key);
@@ -1541,6 +2262,7 @@ int _PySet_Add(int hset, int hkey)
 
 int _PySet_Discard(int hset, int hkey)
 {
+	HOLD_GIL
 	PyObject *set = GetPyObject(hset);
 	PyObject *key = GetPyObject(hkey);
 	return PySet_Discard(set, key);
@@ -1548,12 +2270,14 @@ int _PySet_Discard(int hset, int hkey)
 
 int _PySet_Pop(int hset)
 {
+	HOLD_GIL
 	PyObject *set = GetPyObject(hset);
 	return GetHandle(PySet_Pop(set));
 }
 
 int _PySet_Clear(int hset)
 {
+	HOLD_GIL
 	PyObject *set = GetPyObject(hset);
 	return PySet_Clear(set);
 }
@@ -48,8 +48,125 @@ extern "C" DLL_EXPORT char *_Py_GetBuildInfo();
 extern "C" DLL_EXPORT void _Py_SetPythonHome(char *home);
 extern "C" DLL_EXPORT char *_Py_GetPythonHome();
 
-// helper functions
+// Helper functions
 extern "C" DLL_EXPORT int GetMainModuleDict();
+extern "C" DLL_EXPORT int GatherAttrFloats(int hsequence, int hattr_names, int memID, int offset);
+extern "C" DLL_EXPORT int ScatterAttrFloats(int hsequence, int hattr_names, int memID, int offset);
+
+// Command buffers, see CommandBuffer.cpp
+extern "C" DLL_EXPORT int ExecuteCommandBuffer(int memID, int size, int resultMemID);
+
+// JSON bridge, see JsonBridge.cpp
+extern "C" DLL_EXPORT char *PyObjectToJSON(int hobject);
+extern "C" DLL_EXPORT int PyObjectFromJSON(const char *json);
+
+// Async jobs, see AsyncJobs.cpp
+extern "C" DLL_EXPORT int _PyRun_StringAsync(char *script, int hglobals, int hlocals);
+extern "C" DLL_EXPORT int _PyRun_FileAsync(const char *filename, int hglobals, int hlocals);
+extern "C" DLL_EXPORT int _PyObject_CallAsync(int hcallable_object, int hargs, int hkw);
+extern "C" DLL_EXPORT int PyJob_GetState(int job);
+extern "C" DLL_EXPORT int PyJob_GetResult(int job);
+extern "C" DLL_EXPORT int PyJob_Cancel(int job);
+extern "C" DLL_EXPORT int PyImport_Prefetch(const char *names);
+extern "C" DLL_EXPORT int PyImport_GetPrefetchState(const char *name);
+extern "C" DLL_EXPORT char *PyImport_GetPrefetchError(const char *name);
+
+// AGK media imports, see AgkImport.cpp
+extern "C" DLL_EXPORT void PyImport_AddAgkPath(const char *path);
+extern "C" DLL_EXPORT void PyImport_ClearAgkPaths();
+
+// GIL overhead counters, see PythonThreading.cpp
+extern "C" DLL_EXPORT int PyGIL_GetCallCount();
+extern "C" DLL_EXPORT int PyGIL_GetAcquireCount();
+extern "C" DLL_EXPORT float PyGIL_GetWaitTime();
+extern "C" DLL_EXPORT void PyGIL_ResetStats();
+
+// Worker process pool, see WorkerPool.cpp
+extern "C" DLL_EXPORT int PyPool_Start(const char *python, const char *module, int workers, int slotSize);
+extern "C" DLL_EXPORT void PyPool_Stop();
+extern "C" DLL_EXPORT int PyPool_GetWorkerCount();
+extern "C" DLL_EXPORT int PyPool_Submit(const char *function, const char *argument);
+extern "C" DLL_EXPORT int PyPool_SubmitMemblock(const char *function, int memID, int offset, int size);
+extern "C" DLL_EXPORT int PyPool_GetState(int job);
+extern "C" DLL_EXPORT int PyPool_GetResultSize(int job);
+extern "C" DLL_EXPORT char *PyPool_GetResultString(int job);
+extern "C" DLL_EXPORT int PyPool_CopyResult(int job, int memID, int offset);
+extern "C" DLL_EXPORT void PyPool_Release(int job);
+extern "C" DLL_EXPORT int PyPool_Map(const char *function, int inMemID, int recordSize, int outMemID, int outRecordSize);
+extern "C" DLL_EXPORT float PyPool_GetMapTime();
+extern "C" DLL_EXPORT int PyPool_GetMapWorkerRecords(int worker);
+extern "C" DLL_EXPORT float PyPool_GetMapWorkerThroughput(int worker);
+
+// Coroutine scheduler, see Scheduler.cpp
+extern "C" DLL_EXPORT int PyScheduler_Add(int hiterator, int priority);
+extern "C" DLL_EXPORT void PyScheduler_Remove(int id);
+extern "C" DLL_EXPORT void PyScheduler_Clear();
+extern "C" DLL_EXPORT int PyScheduler_Tick(float budgetMS);
+extern "C" DLL_EXPORT int PyScheduler_GetState(int id);
+extern "C" DLL_EXPORT int PyScheduler_GetCount();
+extern "C" DLL_EXPORT int PyScheduler_GetResult(int id);
+extern "C" DLL_EXPORT float PyScheduler_GetLastTime(int id);
+extern "C" DLL_EXPORT float PyScheduler_GetTotalTime(int id);
+extern "C" DLL_EXPORT int PyScheduler_GetStepCount(int id);
+
+// Frame hooks, see FrameHooks.cpp
+extern "C" DLL_EXPORT int PyHook_Add(int hcallable, int priority, int passDeltaTime);
+extern "C" DLL_EXPORT void PyHook_Remove(int id);
+extern "C" DLL_EXPORT void PyHook_Clear();
+extern "C" DLL_EXPORT int PyHook_Fire(float deltaTime);
+extern "C" DLL_EXPORT int PyHook_GetState(int id);
+extern "C" DLL_EXPORT float PyHook_GetLastTime(int id);
+extern "C" DLL_EXPORT float PyHook_GetTotalTime(int id);
+extern "C" DLL_EXPORT int PyHook_GetCallCount(int id);
+extern "C" DLL_EXPORT float PyHook_GetFireTime();
+
+// Input snapshots, see InputSnapshot.cpp
+extern "C" DLL_EXPORT int PyInput_Capture();
+
+// Spatial hash, see SpatialHash.cpp
+extern "C" DLL_EXPORT int PySpatialHash_New(float cellSize);
+extern "C" DLL_EXPORT int PySpatialHash_RebuildFromSprites(int hgrid, int memID, int offset, int count);
+extern "C" DLL_EXPORT int PySpatialHash_UpdateFromSprites(int hgrid, int memID, int offset, int count);
+extern "C" DLL_EXPORT void PySpatialHash_Set(int hgrid, int id, float x, float y);
+extern "C" DLL_EXPORT int PySpatialHash_Remove(int hgrid, int id);
+extern "C" DLL_EXPORT void PySpatialHash_Clear(int hgrid);
+extern "C" DLL_EXPORT int PySpatialHash_GetCount(int hgrid);
+extern "C" DLL_EXPORT int PySpatialHash_QueryRadius(int hgrid, float x, float y, float radius, int memID, int offset, int maxCount);
+extern "C" DLL_EXPORT int PySpatialHash_QueryRect(int hgrid, float x1, float y1, float x2, float y2, int memID, int offset, int maxCount);
+extern "C" DLL_EXPORT int PySpatialHash_QueryNearest(int hgrid, float x, float y, int k, int memID, int offset);
+
+// Network message schemas, see MessageSchema.cpp
+extern "C" DLL_EXPORT int PyMessageSchema_New(const char *format, const char *names);
+extern "C" DLL_EXPORT int PyMessageSchema_Encode(int hschema, int hvalue);
+extern "C" DLL_EXPORT int PyMessageSchema_Decode(int hschema, int msgID);
+
+// asyncio loop pumping, see AsyncioPump.cpp
+extern "C" DLL_EXPORT int PyAsync_GetLoop();
+extern "C" DLL_EXPORT int PyAsync_Pump(float budgetMS);
+extern "C" DLL_EXPORT int PyAsync_GetTaskCount();
+extern "C" DLL_EXPORT void PyAsync_Close();
+
+// Message queue from Python threads, see MessageQueue.cpp
+extern "C" DLL_EXPORT int PyMsg_Drain(int memID, int maxCount);
+extern "C" DLL_EXPORT int PyMsg_GetPendingCount();
+extern "C" DLL_EXPORT void PyMsg_Clear();
+
+// Sub-interpreters, see Interpreters.cpp
+extern "C" DLL_EXPORT int PyInterp_Create();
+extern "C" DLL_EXPORT void PyInterp_Destroy(int id);
+extern "C" DLL_EXPORT int PyInterp_Switch(int id);
+extern "C" DLL_EXPORT int PyInterp_GetCurrent();
+extern "C" DLL_EXPORT int PyInterp_WarmPool(int count, const char *modules);
+extern "C" DLL_EXPORT int PyInterp_Acquire();
+extern "C" DLL_EXPORT int PyInterp_GetPoolSize();
+
+// Script time budget, see Watchdog.cpp
+extern "C" DLL_EXPORT void PyWatchdog_SetBudget(float budgetMS);
+extern "C" DLL_EXPORT float PyWatchdog_GetBudget();
+extern "C" DLL_EXPORT int PyWatchdog_GetTimeoutCount();
+extern "C" DLL_EXPORT char *PyWatchdog_GetLastLocation();
+extern "C" DLL_EXPORT char *PyWatchdog_GetReport();
+extern "C" DLL_EXPORT void PyWatchdog_ResetStats();
 
 //https://docs.python.org/3/c-api/veryhigh.html
 extern "C" DLL_EXPORT int _PyRun_SimpleString(char *command);
@@ -74,7 +191,7 @@ extern "C" DLL_EXPORT int _Py_SIZE(int hobject);
 extern "C" DLL_EXPORT int _PyImport_ImportModule(const char *name);
 extern "C" DLL_EXPORT int _PyImport_ImportModuleEx(const char *name, int hglobals, int hlocals, int hfromlist);
 extern "C" DLL_EXPORT int _PyImport_Import(int hname);
-extern "C" DLL_EXPORT int _PyImport_ImportS(const char *name);
+extern "C" DLL_EXPORT int _PyImport_ImportS(const char *name); // AGK: PyImport_Import
 extern "C" DLL_EXPORT int _PyImport_ReloadModule(int hModule);
 extern "C" DLL_EXPORT int _PyImport_AddModule(char * name);
 extern "C" DLL_EXPORT int _PyImport_GetModuleDict();
@@ -94,17 +211,17 @@ extern "C" DLL_EXPORT int _Py_BuildValue(const char *format, char *csvtext); //
 extern "C" DLL_EXPORT int _PyObject_HasAttr(int hobject, int hattr_name);
 extern "C" DLL_EXPORT int _PyObject_HasAttrString(int hobject, const char *attr_name);
 extern "C" DLL_EXPORT int _PyObject_GetAttrHandle(int hobject, int hattr_name);
-extern "C" DLL_EXPORT int _PyObject_GetAttrHandleS(int hobject, const char *attr_name);
+extern "C" DLL_EXPORT int _PyObject_GetAttrHandleS(int hobject, const char *attr_name); // AGK: PyObject_GetAttrHandle
 extern "C" DLL_EXPORT float _PyObject_GetAttrFloat(int hobject, const char *attr_name);
 extern "C" DLL_EXPORT int _PyObject_GetAttrInt(int hobject, const char *attr_name);
 extern "C" DLL_EXPORT const char *_PyObject_GetAttrString(int hobject, const char *attr_name);
 extern "C" DLL_EXPORT int _PyObject_SetAttrHandle(int hobject, int hattr_name, int hvalue);
-extern "C" DLL_EXPORT int _PyObject_SetAttrHandleS(int hobject, const char *attr_name, int hvalue);
-extern "C" DLL_EXPORT int _PyObject_SetAttrFloat(int hobject, const char *attr_name, float value);
-extern "C" DLL_EXPORT int _PyObject_SetAttrInt(int hobject, const char *attr_name, int value);
-extern "C" DLL_EXPORT int _PyObject_SetAttrString(int hobject, const char *attr_name, const char *value);
+extern "C" DLL_EXPORT int _PyObject_SetAttrHandleS(int hobject, const char *attr_name, int hvalue); // AGK: PyObject_SetAttrHandle
+extern "C" DLL_EXPORT int _PyObject_SetAttrFloat(int hobject, const char *attr_name, float value); // AGK: PyObject_SetAttr
+extern "C" DLL_EXPORT int _PyObject_SetAttrInt(int hobject, const char *attr_name, int value); // AGK: PyObject_SetAttr
+extern "C" DLL_EXPORT int _PyObject_SetAttrString(int hobject, const char *attr_name, const char *value); // AGK: PyObject_SetAttr
 extern "C" DLL_EXPORT int _PyObject_DelAttr(int hobject, int hattr_name);
-extern "C" DLL_EXPORT int _PyObject_DelAttrString(int hobject, const char *attr_name);
+extern "C" DLL_EXPORT int _PyObject_DelAttrString(int hobject, const char *attr_name); // AGK: PyObject_DelAttr
 extern "C" DLL_EXPORT int _PyObject_ReprObj(int hobject);
 extern "C" DLL_EXPORT const char *_PyObject_Repr(int hobject);
 extern "C" DLL_EXPORT int _PyObject_StrObj(int hobject);
@@ -117,6 +234,13 @@ extern "C" DLL_EXPORT int _PyObject_SetItem(int hobject, int hkey, int hvalue);
 extern "C" DLL_EXPORT int _PyObject_DelItem(int hobject, int hkey);
 extern "C" DLL_EXPORT int _PyObject_GetIter(int hobject);
 
+//https://docs.python.org/3/c-api/iter.html
+extern "C" DLL_EXPORT int _PyIter_Check(int hobject);
+extern "C" DLL_EXPORT int _PyIter_Next(int hiterator);
+extern "C" DLL_EXPORT int _PyIter_NextBatch(int hiterator, int hlist, int maxCount);
+extern "C" DLL_EXPORT int _PyIter_NextFloats(int hiterator, int memID, int offset, int maxCount);
+extern "C" DLL_EXPORT int _PyIter_NextInts(int hiterator, int memID, int offset, int maxCount);
+
 //https://docs.python.org/3/c-api/long.html
 extern "C" DLL_EXPORT int _PyLong_Check(int hobject);
 extern "C" DLL_EXPORT int _PyLong_CheckExact(int hobject);
@@ -133,7 +257,7 @@ extern "C" DLL_EXPORT float _PyFloat_AsDouble(int hdouble);
 extern "C" DLL_EXPORT int _PyUnicode_Check(int hobject);
 extern "C" DLL_EXPORT int _PyUnicode_CheckExact(int hobject);
 extern "C" DLL_EXPORT int _PyUnicode_FromString(const char *value);
-extern "C" DLL_EXPORT const char *_PyUnicode_AsStringPL(int hunicode);
+extern "C" DLL_EXPORT const char *_PyUnicode_AsStringPL(int hunicode); // AGK: PyUnicode_AsString
 
 //https://docs.python.org/3/c-api/tuple.html
 extern "C" DLL_EXPORT int _PyTuple_Check(int hobject);
@@ -147,9 +271,9 @@ extern "C" DLL_EXPORT int _PyTuple_GetItemInt(int hobject, int pos);
 extern "C" DLL_EXPORT const char *_PyTuple_GetItemString(int hobject, int pos);
 extern "C" DLL_EXPORT int _PyTuple_GetSlice(int hobject, int low, int high);
 extern "C" DLL_EXPORT int _PyTuple_SetItemHandle(int hobject, int pos, int hvalue);
-extern "C" DLL_EXPORT int _PyTuple_SetItemFloat(int hobject, int pos, float value);
-extern "C" DLL_EXPORT int _PyTuple_SetItemInt(int hobject, int pos, int value);
-extern "C" DLL_EXPORT int _PyTuple_SetItemString(int hobject, int pos, const char *value);
+extern "C" DLL_EXPORT int _PyTuple_SetItemFloat(int hobject, int pos, float value); // AGK: PyTuple_SetItem
+extern "C" DLL_EXPORT int _PyTuple_SetItemInt(int hobject, int pos, int value); // AGK: PyTuple_SetItem
+extern "C" DLL_EXPORT int _PyTuple_SetItemString(int hobject, int pos, const char *value); // AGK: PyTuple_SetItem
 
 //https://docs.python.org/3/c-api/list.html
 extern "C" DLL_EXPORT int _PyList_Check(int hobject);
@@ -161,17 +285,17 @@ extern "C" DLL_EXPORT float _PyList_GetItemFloat(int hlist, int index);
 extern "C" DLL_EXPORT int _PyList_GetItemInt(int hlist, int index);
 extern "C" DLL_EXPORT const char *_PyList_GetItemString(int hlist, int index);
 extern "C" DLL_EXPORT int _PyList_SetItemHandle(int hlist, int index, int hitem);
-extern "C" DLL_EXPORT int _PyList_SetItemFloat(int hlist, int index, float item);
-extern "C" DLL_EXPORT int _PyList_SetItemInt(int hlist, int index, int item);
-extern "C" DLL_EXPORT int _PyList_SetItemString(int hlist, int index, const char *item);
+extern "C" DLL_EXPORT int _PyList_SetItemFloat(int hlist, int index, float item); // AGK: PyList_SetItem
+extern "C" DLL_EXPORT int _PyList_SetItemInt(int hlist, int index, int item); // AGK: PyList_SetItem
+extern "C" DLL_EXPORT int _PyList_SetItemString(int hlist, int index, const char *item); // AGK: PyList_SetItem
 extern "C" DLL_EXPORT int _PyList_InsertHandle(int hlist, int index, int hitem);
-extern "C" DLL_EXPORT int _PyList_InsertFloat(int hlist, int index, float value);
-extern "C" DLL_EXPORT int _PyList_InsertInt(int hlist, int index, int value);
-extern "C" DLL_EXPORT int _PyList_InsertString(int hlist, int index, const char *value);
+extern "C" DLL_EXPORT int _PyList_InsertFloat(int hlist, int index, float value); // AGK: PyList_Insert
+extern "C" DLL_EXPORT int _PyList_InsertInt(int hlist, int index, int value); // AGK: PyList_Insert
+extern "C" DLL_EXPORT int _PyList_InsertString(int hlist, int index, const char *value); // AGK: PyList_Insert
 extern "C" DLL_EXPORT int _PyList_AppendHandle(int hlist, int hitem);
-extern "C" DLL_EXPORT int _PyList_AppendFloat(int hlist, float value);
-extern "C" DLL_EXPORT int _PyList_AppendInt(int hlist, int value);
-extern "C" DLL_EXPORT int _PyList_AppendString(int hlist, const char *value);
+extern "C" DLL_EXPORT int _PyList_AppendFloat(int hlist, float value); // AGK: PyList_Append
+extern "C" DLL_EXPORT int _PyList_AppendInt(int hlist, int value); // AGK: PyList_Append
+extern "C" DLL_EXPORT int _PyList_AppendString(int hlist, const char *value); // AGK: PyList_Append
 extern "C" DLL_EXPORT int _PyList_GetSlice(int hlist, int low, int high);
 extern "C" DLL_EXPORT int _PyList_SetSlice(int hlist, int low, int high, int hitemlist);
 extern "C" DLL_EXPORT int _PyList_Sort(int hlist);
@@ -184,17 +308,17 @@ extern "C" DLL_EXPORT int _PyDict_CheckExact(int hobject);
 extern "C" DLL_EXPORT int _PyDict_New();
 extern "C" DLL_EXPORT void _PyDict_Clear(int hdict);
 extern "C" DLL_EXPORT int _PyDict_ContainsKey(int hdict, int hkey);
-extern "C" DLL_EXPORT int _PyDict_ContainsKeyS(int hdict, const char *key);
+extern "C" DLL_EXPORT int _PyDict_ContainsKeyS(int hdict, const char *key); // AGK: PyDict_ContainsKey
 extern "C" DLL_EXPORT int _PyDict_Copy(int hdict);
 extern "C" DLL_EXPORT int _PyDict_SetItemHandle(int hdict, int hkey, int hvalue);
-extern "C" DLL_EXPORT int _PyDict_SetItemHandleS(int hdict, const char *key, int hvalue);
-extern "C" DLL_EXPORT int _PyDict_SetItemFloat(int hdict, const char *key, float value);
-extern "C" DLL_EXPORT int _PyDict_SetItemInt(int hdict, const char *key, int value);
-extern "C" DLL_EXPORT int _PyDict_SetItemString(int hdict, const char *key, const char *value);
+extern "C" DLL_EXPORT int _PyDict_SetItemHandleS(int hdict, const char *key, int hvalue); // AGK: PyDict_SetItemHandle
+extern "C" DLL_EXPORT int _PyDict_SetItemFloat(int hdict, const char *key, float value); // AGK: PyDict_SetItem
+extern "C" DLL_EXPORT int _PyDict_SetItemInt(int hdict, const char *key, int value); // AGK: PyDict_SetItem
+extern "C" DLL_EXPORT int _PyDict_SetItemString(int hdict, const char *key, const char *value); // AGK: PyDict_SetItem
 extern "C" DLL_EXPORT int _PyDict_DelItem(int hdict, int hkey);
-extern "C" DLL_EXPORT int _PyDict_DelItemString(int hdict, const char *key);
+extern "C" DLL_EXPORT int _PyDict_DelItemString(int hdict, const char *key); // AGK: PyDict_DelItem
 extern "C" DLL_EXPORT int _PyDict_GetItemHandle(int hdict, int hkey);
-extern "C" DLL_EXPORT int _PyDict_GetItemHandleS(int hdict, const char *key);
+extern "C" DLL_EXPORT int _PyDict_GetItemHandleS(int hdict, const char *key); // AGK: PyDict_GetItemHandle
 extern "C" DLL_EXPORT float _PyDict_GetItemFloat(int hdict, const char *key);
 extern "C" DLL_EXPORT int _PyDict_GetItemInt(int hdict, const char *key);
 extern "C" DLL_EXPORT const char *_PyDict_GetItemString(int hdict, const char *key);
@@ -206,6 +330,18 @@ extern "C" DLL_EXPORT int _PyDict_Values(int hdict);
 extern "C" DLL_EXPORT int _PyDict_Size(int hdict);
 extern "C" DLL_EXPORT int _PyDict_Merge(int hdicta, int hdictb, int override);
 extern "C" DLL_EXPORT int _PyDict_Update(int hdicta, int hdictb);
+extern "C" DLL_EXPORT int _PyDict_NextItem(int hdict, int pos); // AGK: PyDict_Next
+extern "C" DLL_EXPORT int _PyDict_NextKeyHandle();
+extern "C" DLL_EXPORT const char *_PyDict_NextKeyString();
+extern "C" DLL_EXPORT int _PyDict_NextValueHandle();
+extern "C" DLL_EXPORT float _PyDict_NextValueFloat();
+extern "C" DLL_EXPORT int _PyDict_NextValueInt();
+extern "C" DLL_EXPORT const char *_PyDict_NextValueString();
+extern "C" DLL_EXPORT int _PyDict_KeysToInts(int hdict, int memID, int offset);
+extern "C" DLL_EXPORT const char *_PyDict_KeysToString(int hdict, const char *delimiter);
+extern "C" DLL_EXPORT int _PyDict_ValuesToFloats(int hdict, int memID, int offset);
+extern "C" DLL_EXPORT int _PyDict_ValuesToInts(int hdict, int memID, int offset);
+extern "C" DLL_EXPORT const char *_PyDict_ValuesToString(int hdict, const char *delimiter);
 
 //https://docs.python.org/3/c-api/set.html
 extern "C" DLL_EXPORT int _PySet_Check(int hobject);
@@ -0,0 +1,156 @@
+/*
+Copyright (c) 2017 Adam Biser <adambiser@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "PythonPlugin.h"
+#include "PythonThreading.h"
+
+// The main thread's state while it does not hold the GIL.  NULL when Python is not initialized.
+PyThreadState *m_MainThreadState = NULL;
+std::thread::id m_MainThreadID;
+std::atomic<bool> m_ThreadedMode(false);
+// How many ScopedGILs the current thread is inside of.
+thread_local int t_GILDepth = 0;
+
+// Overhead counters, see PyGIL_GetCallCount, etc.
+std::atomic<int> m_GILCallCount(0);
+std::atomic<int> m_GILAcquireCount(0);
+std::atomic<long long> m_GILWaitNanoseconds(0);
+
+void InitThreads()
+{
+	PyEval_InitThreads();
+	m_MainThreadID = std::this_thread::get_id();
+	m_ThreadedMode = true;
+	m_MainThreadState = PyEval_SaveThread();
+}
+
+void FinalizeThreads()
+{
+	if (m_MainThreadState != NULL)
+	{
+		PyEval_RestoreThread(m_MainThreadState);
+		m_MainThreadState = NULL;
+	}
+	m_ThreadedMode = false;
+}
+
+bool IsMainThread()
+{
+	return std::this_thread::get_id() == m_MainThreadID;
+}
+
+bool CheckMainThread(const char *prefix, const char *function)
+{
+	if (!IsMainThread())
+	{
+		PyErr_Format(PyExc_RuntimeError, "%s.%s can only be called from the AGK main thread.", prefix, function);
+		return false;
+	}
+	return true;
+}
+
+ScopedGIL::ScopedGIL() : m_Mode(GIL_NONE)
+{
+	m_GILCallCount.fetch_add(1, std::memory_order_relaxed);
+	if (t_GILDepth > 0)
+	{
+		t_GILDepth++;
+		m_Mode = GIL_NESTED;
+		return;
+	}
+	if (!m_ThreadedMode)
+	{
+		return;
+	}
+	auto start = std::chrono::steady_clock::now();
+	if (std::this_thread::get_id() == m_MainThreadID)
+	{
+		// NULL while FinalizeThreads has the GIL.
+		if (m_MainThreadState == NULL)
+		{
+			return;
+		}
+		PyEval_RestoreThread(m_MainThreadState);
+		WatchdogEnterCall();
+		m_Mode = GIL_MAIN;
+	}
+	else
+	{
+		m_GILState = PyGILState_Ensure();
+		m_Mode = GIL_ENSURED;
+	}
+	auto waited = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+	m_GILWaitNanoseconds.fetch_add(waited.count(), std::memory_order_relaxed);
+	m_GILAcquireCount.fetch_add(1, std::memory_order_relaxed);
+	t_GILDepth = 1;
+}
+
+ScopedGIL::~ScopedGIL()
+{
+	switch (m_Mode)
+	{
+	case GIL_NONE:
+		break;
+	case GIL_NESTED:
+		t_GILDepth--;
+		break;
+	case GIL_MAIN:
+		WatchdogLeaveCall();
+		t_GILDepth = 0;
+		m_MainThreadState = PyEval_SaveThread();
+		break;
+	case GIL_ENSURED:
+		t_GILDepth = 0;
+		PyGILState_Release(m_GILState);
+		break;
+	}
+}
+
+/*
+GIL overhead counters.  Every exported function counts as one call.  Only calls that actually had to take the GIL
+count as acquires, and the wait time is the total time spent taking it, in milliseconds.
+*/
+int PyGIL_GetCallCount()
+{
+	return m_GILCallCount;
+}
+
+int PyGIL_GetAcquireCount()
+{
+	return m_GILAcquireCount;
+}
+
+float PyGIL_GetWaitTime()
+{
+	return (float)(m_GILWaitNanoseconds / 1000000.0);
+}
+
+void PyGIL_ResetStats()
+{
+	m_GILCallCount = 0;
+	m_GILAcquireCount = 0;
+	m_GILWaitNanoseconds = 0;
+}
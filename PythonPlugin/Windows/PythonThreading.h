@@ -0,0 +1,75 @@
+/*
+Copyright (c) 2017 Adam Biser <adambiser@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef PYTHON_THREADING_H_
+#define PYTHON_THREADING_H_
+
+#include "PluginHelpers.h"
+
+/*
+Threaded mode.
+
+Once Python is initialized, the AGK main thread releases the GIL so that plugin-owned worker threads and threads
+started by Python code can run between plugin calls.  Exported functions take the GIL back for their duration
+with HOLD_GIL.
+
+HOLD_GIL is cheap when the calling thread already holds the GIL through an outer HOLD_GIL: it only bumps a
+thread-local depth.  Threads other than the AGK main thread use PyGILState_Ensure/Release.
+*/
+void InitThreads();
+void FinalizeThreads();
+// Whether the calling thread is the AGK main thread, the only one that may call AGK commands.
+bool IsMainThread();
+// Raises RuntimeError and returns false when not called from the AGK main thread.  The error names the function as
+// prefix.function, e.g. agk.CreateSprite.  Requires the GIL.
+bool CheckMainThread(const char *prefix, const char *function);
+
+class ScopedGIL
+{
+public:
+	ScopedGIL();
+	~ScopedGIL();
+private:
+	enum Mode
+	{
+		GIL_NONE,		// Python is not in threaded mode.
+		GIL_NESTED,		// An outer ScopedGIL on this thread already holds the GIL.
+		GIL_MAIN,		// Restored the main thread's saved state.
+		GIL_ENSURED,	// Any other thread.
+	};
+	Mode m_Mode;
+	PyGILState_STATE m_GILState;
+};
+
+// Holds the GIL until the end of the enclosing scope.  Use at the start of every exported function that touches Python.
+#define HOLD_GIL	ScopedGIL scopedGIL;
+
+// Defined in AsyncJobs.cpp.  Stops the worker thread and releases all jobs.  Called with the GIL released.
+void ShutdownAsyncJobs();
+
+// Defined in Watchdog.cpp.  ScopedGIL brackets each call from the main thread with these.
+void WatchdogEnterCall();
+void WatchdogLeaveCall();
+// Stops the watchdog thread and disables the budget.  Called with the GIL released.
+void ShutdownWatchdog();
+
+#endif // PYTHON_THREADING_H_
@@ -0,0 +1,172 @@
+/*
+Copyright (c) 2017 Adam Biser <adambiser@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+Batch physics raycasts for the agk module.
+
+Each command casts a buffer of ray segments in a native loop and writes every result into output buffers, so an AI
+checking line of sight for 500 agents makes one Python call instead of 500 casts and 2500 getters:
+
+	rays = array.array('f', [x, y, x2, y2, ...])			# 4 floats per ray.
+	hits = array.array('f', bytes(4 * 5 * count))			# x, y, normalX, normalY, fraction per ray.
+	sprites = array.array('i', bytes(4 * count))			# The sprite hit, or 0.
+	hitCount = agk.PhysicsRayCasts(rays, hits, sprites)
+
+	rays = array.array('f', [x, y, z, x2, y2, z2, ...])		# 6 floats per ray.
+	hits = array.array('f', bytes(4 * 7 * count))			# x, y, z, normalX, normalY, normalZ, fraction per ray.
+	objects = array.array('i', bytes(4 * count))			# The closest object hit, or 0.
+	hitCount = agk.PhysicsRayCasts3D(rays, hits, objects)
+
+A ray that hits nothing reports its end point, a zero normal and a fraction of 1.
+PhysicsRayCasts takes an optional category mask, as PhysicsRayCastCategory does.
+*/
+
+#include "AgkModule.h"
+#include "PythonPlugin.h"
+#include "PythonThreading.h"
+#include "PluginHelpers.h"
+#ifdef PLUGIN
+#include "..\AGKLibraryCommands.h"
+#endif
+
+#define RAY_2D_FLOATS	4
+#define HIT_2D_FLOATS	5
+#define RAY_3D_FLOATS	6
+#define HIT_3D_FLOATS	7
+
+AGK_THUNK(PhysicsRayCasts)
+{
+	AGK_BEGIN(PhysicsRayCasts, 3, 4)
+	BufferArg rays, hits, sprites;
+	unsigned int category = 0;
+	if (!rays.Get(args[0], 'f', false, "PhysicsRayCasts", 0) || !hits.Get(args[1], 'f', true, "PhysicsRayCasts", 1)
+		|| !sprites.Get(args[2], 'i', true, "PhysicsRayCasts", 2)
+		|| (nargs == 4 && !ToUInt(args[3], category)))
+	{
+		return NULL;
+	}
+	Py_ssize_t count = rays.count / RAY_2D_FLOATS;
+	if (!CheckBatchCount("PhysicsRayCasts", 1, hits.count / HIT_2D_FLOATS, count)
+		|| !CheckBatchCount("PhysicsRayCasts", 2, sprites.count, count))
+	{
+		return NULL;
+	}
+	const float *ray = (const float *)rays.data;
+	float *hit = (float *)hits.data;
+	int *spriteIDs = (int *)sprites.data;
+	int hitCount = 0;
+	for (Py_ssize_t index = 0; index < count; index++, ray += RAY_2D_FLOATS, hit += HIT_2D_FLOATS)
+	{
+		int result = (nargs == 4) ? agk::PhysicsRayCastCategory(category, ray[0], ray[1], ray[2], ray[3])
+			: agk::PhysicsRayCast(ray[0], ray[1], ray[2], ray[3]);
+		if (result)
+		{
+			hit[0] = agk::GetRayCastX();
+			hit[1] = agk::GetRayCastY();
+			hit[2] = agk::GetRayCastNormalX();
+			hit[3] = agk::GetRayCastNormalY();
+			hit[4] = agk::GetRayCastFraction();
+			spriteIDs[index] = (int)agk::GetRayCastSpriteID();
+			hitCount++;
+		}
+		else
+		{
+			hit[0] = ray[2];
+			hit[1] = ray[3];
+			hit[2] = 0;
+			hit[3] = 0;
+			hit[4] = 1.0f;
+			spriteIDs[index] = 0;
+		}
+	}
+	return PyLong_FromLong(hitCount);
+}
+
+AGK_THUNK(PhysicsRayCasts3D)
+{
+	AGK_BEGIN(PhysicsRayCasts3D, 3, 3)
+	BufferArg rays, hits, objects;
+	if (!rays.Get(args[0], 'f', false, "PhysicsRayCasts3D", 0)
+		|| !hits.Get(args[1], 'f', true, "PhysicsRayCasts3D", 1)
+		|| !objects.Get(args[2], 'i', true, "PhysicsRayCasts3D", 2))
+	{
+		return NULL;
+	}
+	Py_ssize_t count = rays.count / RAY_3D_FLOATS;
+	if (!CheckBatchCount("PhysicsRayCasts3D", 1, hits.count / HIT_3D_FLOATS, count)
+		|| !CheckBatchCount("PhysicsRayCasts3D", 2, objects.count, count))
+	{
+		return NULL;
+	}
+	// One ray and three vectors are reused for every cast.
+	unsigned int rayID = agk::Create3DPhysicsRay();
+	unsigned int from = agk::CreateVector3();
+	unsigned int to = agk::CreateVector3();
+	unsigned int result = agk::CreateVector3();
+	const float *ray = (const float *)rays.data;
+	float *hit = (float *)hits.data;
+	int *objectIDs = (int *)objects.data;
+	int hitCount = 0;
+	for (Py_ssize_t index = 0; index < count; index++, ray += RAY_3D_FLOATS, hit += HIT_3D_FLOATS)
+	{
+		agk::SetVector3(from, ray[0], ray[1], ray[2]);
+		agk::SetVector3(to, ray[3], ray[4], ray[5]);
+		// 0 = closest contact only.
+		agk::RayCast3DPhysics(rayID, from, to, 0);
+		int objectID = agk::Get3DPhysicsRayCastClosestObjectHit(rayID);
+		if (objectID)
+		{
+			agk::Get3DPhysicsRayCastClosestContactPosition(rayID, result);
+			hit[0] = agk::GetVector3X(result);
+			hit[1] = agk::GetVector3Y(result);
+			hit[2] = agk::GetVector3Z(result);
+			agk::Get3DPhysicsRayCastNormalVector(rayID, result);
+			hit[3] = agk::GetVector3X(result);
+			hit[4] = agk::GetVector3Y(result);
+			hit[5] = agk::GetVector3Z(result);
+			hit[6] = agk::Get3DPhysicsRayCastFraction(rayID);
+			hitCount++;
+		}
+		else
+		{
+			hit[0] = ray[3];
+			hit[1] = ray[4];
+			hit[2] = ray[5];
+			hit[3] = 0;
+			hit[4] = 0;
+			hit[5] = 0;
+			hit[6] = 1.0f;
+		}
+		objectIDs[index] = objectID;
+	}
+	agk::DeleteVector3(result);
+	agk::DeleteVector3(to);
+	agk::DeleteVector3(from);
+	agk::Delete3DPhysicsRay(rayID);
+	return PyLong_FromLong(hitCount);
+}
+
+PyMethodDef RaycastBatchMethods[] = {
+	AGK_METHOD(PhysicsRayCasts, "PhysicsRayCasts(rays, hits, sprites[, category]) -> int"),
+	AGK_METHOD(PhysicsRayCasts3D, "PhysicsRayCasts3D(rays, hits, objects) -> int"),
+	{ NULL, NULL, 0, NULL }
+};
@@ -0,0 +1,264 @@
+/*
+Copyright (c) 2017 Adam Biser <adambiser@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+Cooperative scheduler for Python generators.
+
+Add generators (or any iterators) with PyScheduler_Add, then call PyScheduler_Tick once per frame.  Each tick steps
+the ready coroutines in priority order, highest first, until the time budget runs out.  What a coroutine yields
+decides when it runs next:
+
+	None		the next tick
+	int n		after n more ticks
+	float s		after s seconds
+
+A coroutine that returns or raises is finished.  Its return value can be read with PyScheduler_GetResult.
+
+Each coroutine runs in the interpreter that was active when it was added.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+
+#include "CallRegistry.h"
+#include "PythonPlugin.h"
+#include "PythonErrorHandling.h"
+#include "PythonThreading.h"
+#include "PluginHelpers.h"
+#ifdef PLUGIN
+#include "..\AGKLibraryCommands.h"
+#endif
+
+enum CoroutineState
+{
+	COROUTINE_FAILED = -1,
+	COROUTINE_UNKNOWN = 0,
+	COROUTINE_RUNNING = 1,
+	COROUTINE_FINISHED = 2,
+};
+
+struct Coroutine : CallEntry
+{
+	PyObject *iterator; // NULL once finished.
+	PyObject *result;
+	CoroutineState state;
+	long long wakeTick;
+	CallClock::time_point wakeTime;
+
+	void ReleaseObjects() override
+	{
+		Py_CLEAR(iterator);
+		Py_CLEAR(result);
+	}
+};
+
+CallRegistry m_Coroutines("coroutine");
+long long m_SchedulerTick = 0;
+
+static Coroutine *GetCoroutine(int id, const char *caller)
+{
+	return static_cast<Coroutine *>(m_Coroutines.Get(id, caller));
+}
+
+/*
+Adds a generator to the scheduler.  The scheduler keeps its own reference to it.
+Higher priority coroutines are stepped first.  Returns the coroutine id.
+*/
+int PyScheduler_Add(int hiterator, int priority)
+{
+	HOLD_GIL
+	REQUIRED_HANDLE(hiterator)
+	PyObject *iterator = GetPyObject(hiterator);
+	if (!PyIter_Check(iterator))
+	{
+		agk::PluginError("PyScheduler_Add: The object is not an iterator.");
+		return 0;
+	}
+	Coroutine *coroutine = new Coroutine();
+	coroutine->iterator = iterator;
+	Py_INCREF(iterator);
+	coroutine->state = COROUTINE_RUNNING;
+	coroutine->wakeTick = m_SchedulerTick;
+	return m_Coroutines.Add(coroutine, priority);
+}
+
+/*
+Removes a coroutine and releases the scheduler's references to it.
+*/
+void PyScheduler_Remove(int id)
+{
+	HOLD_GIL
+	if (GetCoroutine(id, __FUNCTION__))
+	{
+		m_Coroutines.Remove(id);
+	}
+}
+
+void PyScheduler_Clear()
+{
+	HOLD_GIL
+	m_Coroutines.Clear();
+}
+
+void ReleaseInterpreterCoroutines(int id)
+{
+	m_Coroutines.ReleaseInterpreter(id);
+}
+
+static bool IsReady(Coroutine *coroutine, CallClock::time_point now)
+{
+	return coroutine->state == COROUTINE_RUNNING && m_SchedulerTick >= coroutine->wakeTick && now >= coroutine->wakeTime;
+}
+
+static void StepCoroutine(Coroutine *coroutine, CallClock::time_point now)
+{
+	PyObject *yielded = (*Py_TYPE(coroutine->iterator)->tp_iternext)(coroutine->iterator);
+	if (yielded == NULL)
+	{
+		if (!PyErr_Occurred() || PyErr_ExceptionMatches(PyExc_StopIteration))
+		{
+			// Keep the generator's return value.
+			PyObject *type, *value, *traceback;
+			PyErr_Fetch(&type, &value, &traceback);
+			PyErr_NormalizeException(&type, &value, &traceback);
+			coroutine->result = (value) ? PyObject_GetAttrString(value, "value") : NULL;
+			Py_XDECREF(type);
+			Py_XDECREF(value);
+			Py_XDECREF(traceback);
+			coroutine->state = COROUTINE_FINISHED;
+		}
+		else
+		{
+			coroutine->state = COROUTINE_FAILED;
+		}
+		Py_CLEAR(coroutine->iterator);
+		return;
+	}
+	if (PyFloat_Check(yielded))
+	{
+		coroutine->wakeTick = m_SchedulerTick + 1;
+		coroutine->wakeTime = now + std::chrono::duration_cast<CallClock::duration>(std::chrono::duration<double>(PyFloat_AS_DOUBLE(yielded)));
+	}
+	else if (PyLong_Check(yielded))
+	{
+		int overflow;
+		long ticks = PyLong_AsLongAndOverflow(yielded, &overflow);
+		long long delay = (overflow > 0) ? LLONG_MAX : std::max(1L, ticks);
+		// Saturate so that a huge delay sleeps forever instead of overflowing.
+		coroutine->wakeTick = (delay > LLONG_MAX - m_SchedulerTick) ? LLONG_MAX : m_SchedulerTick + delay;
+	}
+	else
+	{
+		coroutine->wakeTick = m_SchedulerTick + 1;
+	}
+	Py_DECREF(yielded);
+}
+
+/*
+Steps each ready coroutine once, in priority order, until budgetMS milliseconds have passed.
+A budget of 0 or less steps every ready coroutine.  Returns the number of coroutines stepped.
+Coroutines that raise an error are marked as failed and their error is reported.
+*/
+int PyScheduler_Tick(float budgetMS)
+{
+	HOLD_GIL
+	CallClock::time_point deadline = CallClock::now() + std::chrono::duration_cast<CallClock::duration>(std::chrono::duration<double, std::milli>(budgetMS));
+	int stepped = m_Coroutines.Run(
+		[](CallEntry *entry, CallClock::time_point now) {
+			return IsReady(static_cast<Coroutine *>(entry), now);
+		},
+		[](CallEntry *entry, CallClock::time_point now) {
+			Coroutine *coroutine = static_cast<Coroutine *>(entry);
+			StepCoroutine(coroutine, now);
+			return coroutine->state != COROUTINE_FAILED;
+		},
+		[budgetMS, deadline](CallClock::time_point now) { return budgetMS <= 0 || now < deadline; });
+	m_SchedulerTick++;
+	return stepped;
+}
+
+/*
+Returns one of: -1 = failed, 0 = unknown coroutine, 1 = running, 2 = finished.
+*/
+int PyScheduler_GetState(int id)
+{
+	Coroutine *coroutine = static_cast<Coroutine *>(m_Coroutines.Find(id));
+	return (coroutine) ? coroutine->state : COROUTINE_UNKNOWN;
+}
+
+/*
+Returns the number of coroutines that are still running.
+*/
+int PyScheduler_GetCount()
+{
+	int count = 0;
+	for (auto &entry : m_Coroutines.GetEntries())
+	{
+		if (static_cast<Coroutine *>(entry.second)->state == COROUTINE_RUNNING)
+		{
+			count++;
+		}
+	}
+	return count;
+}
+
+/*
+Returns the return value of a finished coroutine.
+Borrowed ref.  The scheduler holds it until the coroutine is removed.
+*/
+int PyScheduler_GetResult(int id)
+{
+	HOLD_GIL
+	Coroutine *coroutine = GetCoroutine(id, __FUNCTION__);
+	if (coroutine == NULL || coroutine->result == NULL)
+	{
+		return 0;
+	}
+	if (coroutine->interpreter != PyInterp_GetCurrent())
+	{
+		agk::PluginError("PyScheduler_GetResult: The coroutine belongs to another interpreter.");
+		return 0;
+	}
+	return GetHandle(coroutine->result);
+}
+
+/*
+Per-coroutine timing, in milliseconds.
+*/
+float PyScheduler_GetLastTime(int id)
+{
+	Coroutine *coroutine = GetCoroutine(id, __FUNCTION__);
+	return (coroutine) ? (float)(coroutine->lastTime * 1000.0) : 0.0f;
+}
+
+float PyScheduler_GetTotalTime(int id)
+{
+	Coroutine *coroutine = GetCoroutine(id, __FUNCTION__);
+	return (coroutine) ? (float)(coroutine->totalTime * 1000.0) : 0.0f;
+}
+
+int PyScheduler_GetStepCount(int id)
+{
+	Coroutine *coroutine = GetCoroutine(id, __FUNCTION__);
+	return (coroutine) ? coroutine->calls : 0;
+}
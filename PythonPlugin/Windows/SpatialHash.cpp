@@ -0,0 +1,729 @@
+/*
+Copyright (c) 2017 Adam Biser <adambiser@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+Spatial hash for neighbour queries.
+
+agk.SpatialHash buckets 2D points by a square cell size so that radius, rectangle and nearest-neighbour queries only
+look at nearby cells instead of every entity:
+
+	grid = agk.SpatialHash(64.0)
+	grid.rebuild(ids, xs, ys)					# Or grid.rebuild(sprites) to read sprite positions.
+	grid.update(moved, xs, ys)					# Inserts or moves only these entries.
+	out = array.array('i', bytes(4 * 256))
+	count = grid.query_radius(x, y, 100.0, out)	# IDs written to out.
+
+ids are 32-bit integer buffers and positions are 32-bit float buffers or single numbers, as for the batch sprite
+commands.  Sprite positions are read with GetSpriteXByOffset/GetSpriteYByOffset.  query_radius and query_rect return
+the number of matches, which can be more than the output buffer holds.  query_nearest writes up to k IDs, nearest
+first.
+
+A cell size near the usual query radius works best.
+
+AGK script uses the same object through its handle with the PySpatialHash_* commands.  IDs are passed in memblocks of
+32-bit integers.
+*/
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "AgkModule.h"
+#include "PythonPlugin.h"
+#include "PythonErrorHandling.h"
+#include "PythonThreading.h"
+#include "PluginHelpers.h"
+#ifdef PLUGIN
+#include "..\AGKLibraryCommands.h"
+#endif
+
+typedef unsigned long long CellKey;
+
+class SpatialHash
+{
+public:
+	explicit SpatialHash(float cellSize);
+	void Clear();
+	void Reserve(size_t count) { m_Entries.reserve(count); m_Index.reserve(count); }
+	// Inserts the ID or moves it if it is already in the hash.
+	void Set(int id, float x, float y);
+	bool Remove(int id);
+	Py_ssize_t Count() const { return (Py_ssize_t)m_Entries.size(); }
+	// These return the number of matches and write up to capacity IDs.
+	Py_ssize_t QueryRadius(float x, float y, float radius, int *out, Py_ssize_t capacity) const;
+	Py_ssize_t QueryRect(float x1, float y1, float x2, float y2, int *out, Py_ssize_t capacity) const;
+	// Writes up to k IDs, nearest first, and returns how many were written.
+	Py_ssize_t QueryNearest(float x, float y, Py_ssize_t k, int *out);
+private:
+	struct Entry
+	{
+		int id;
+		float x, y;
+		CellKey cell;
+		size_t slot; // Index in the cell's list.
+	};
+	// Cell coordinates are clamped to +/-CELL_LIMIT so that NaN and huge positions can't overflow an int, and neither
+	// can the ring arithmetic in QueryNearest.  NaN goes to -CELL_LIMIT.
+	static const int CELL_LIMIT = 1 << 29;
+	int CellCoord(float value) const
+	{
+		float cell = std::floor(value * m_InvCellSize);
+		if (cell >= CELL_LIMIT)
+		{
+			return CELL_LIMIT;
+		}
+		return (cell > -CELL_LIMIT) ? (int)cell : -CELL_LIMIT;
+	}
+	static CellKey MakeKey(int cx, int cy) { return ((CellKey)(unsigned int)cx << 32) | (unsigned int)cy; }
+	void AddToCell(size_t entry, CellKey cell);
+	void RemoveFromCell(size_t entry);
+	// Calls visit(entry) for the entries in the cells from (cx1, cy1) to (cx2, cy2).  When scan is true and the range
+	// has more cells than the hash, it calls visit for every entry instead.
+	template <typename Visit>
+	void VisitCells(int cx1, int cy1, int cx2, int cy2, bool scan, Visit visit) const;
+	float m_CellSize;
+	float m_InvCellSize;
+	std::vector<Entry> m_Entries;
+	std::unordered_map<int, size_t> m_Index;
+	std::unordered_map<CellKey, std::vector<size_t>> m_Cells;
+	// The range of cell coordinates that have held entries since the last Clear.
+	int m_MinX, m_MinY, m_MaxX, m_MaxY;
+	// Reused by QueryNearest.
+	std::vector<std::pair<float, int>> m_Nearest;
+};
+
+SpatialHash::SpatialHash(float cellSize)
+	: m_CellSize(cellSize), m_InvCellSize(1.0f / cellSize)
+{
+	Clear();
+}
+
+void SpatialHash::Clear()
+{
+	// Keep the cell lists' memory for the next rebuild unless moving entities have left many cells empty.
+	if (m_Cells.size() > m_Entries.size() * 2 + 64)
+	{
+		m_Cells.clear();
+	}
+	else
+	{
+		for (auto &cell : m_Cells)
+		{
+			cell.second.clear();
+		}
+	}
+	m_Entries.clear();
+	m_Index.clear();
+	m_MinX = m_MinY = INT_MAX;
+	m_MaxX = m_MaxY = INT_MIN;
+}
+
+void SpatialHash::AddToCell(size_t entry, CellKey cell)
+{
+	std::vector<size_t> &list = m_Cells[cell];
+	m_Entries[entry].cell = cell;
+	m_Entries[entry].slot = list.size();
+	list.push_back(entry);
+}
+
+void SpatialHash::RemoveFromCell(size_t entry)
+{
+	std::vector<size_t> &list = m_Cells[m_Entries[entry].cell];
+	size_t slot = m_Entries[entry].slot;
+	list[slot] = list.back();
+	m_Entries[list[slot]].slot = slot;
+	list.pop_back();
+}
+
+void SpatialHash::Set(int id, float x, float y)
+{
+	int cx = CellCoord(x);
+	int cy = CellCoord(y);
+	CellKey cell = MakeKey(cx, cy);
+	m_MinX = std::min(m_MinX, cx);
+	m_MinY = std::min(m_MinY, cy);
+	m_MaxX = std::max(m_MaxX, cx);
+	m_MaxY = std::max(m_MaxY, cy);
+	auto found = m_Index.find(id);
+	if (found != m_Index.end())
+	{
+		Entry &entry = m_Entries[found->second];
+		entry.x = x;
+		entry.y = y;
+		if (entry.cell != cell)
+		{
+			RemoveFromCell(found->second);
+			AddToCell(found->second, cell);
+		}
+		return;
+	}
+	size_t index = m_Entries.size();
+	m_Entries.push_back({ id, x, y, 0, 0 });
+	m_Index[id] = index;
+	AddToCell(index, cell);
+}
+
+bool SpatialHash::Remove(int id)
+{
+	auto found = m_Index.find(id);
+	if (found == m_Index.end())
+	{
+		return false;
+	}
+	size_t index = found->second;
+	m_Index.erase(found);
+	RemoveFromCell(index);
+	// Move the last entry into the gap.
+	size_t last = m_Entries.size() - 1;
+	if (index != last)
+	{
+		m_Entries[index] = m_Entries[last];
+		m_Cells[m_Entries[index].cell][m_Entries[index].slot] = index;
+		m_Index[m_Entries[index].id] = index;
+	}
+	m_Entries.pop_back();
+	return true;
+}
+
+template <typename Visit>
+void SpatialHash::VisitCells(int cx1, int cy1, int cx2, int cy2, bool scan, Visit visit) const
+{
+	cx1 = std::max(cx1, m_MinX);
+	cy1 = std::max(cy1, m_MinY);
+	cx2 = std::min(cx2, m_MaxX);
+	cy2 = std::min(cy2, m_MaxY);
+	if (cx1 > cx2 || cy1 > cy2)
+	{
+		return;
+	}
+	if (scan && ((double)cx2 - cx1 + 1) * ((double)cy2 - cy1 + 1) > (double)m_Cells.size())
+	{
+		for (size_t index = 0; index < m_Entries.size(); index++)
+		{
+			visit(m_Entries[index]);
+		}
+		return;
+	}
+	for (int cx = cx1; cx <= cx2; cx++)
+	{
+		for (int cy = cy1; cy <= cy2; cy++)
+		{
+			auto found = m_Cells.find(MakeKey(cx, cy));
+			if (found == m_Cells.end())
+			{
+				continue;
+			}
+			for (size_t index : found->second)
+			{
+				visit(m_Entries[index]);
+			}
+		}
+	}
+}
+
+Py_ssize_t SpatialHash::QueryRadius(float x, float y, float radius, int *out, Py_ssize_t capacity) const
+{
+	float radius2 = radius * radius;
+	Py_ssize_t count = 0;
+	VisitCells(CellCoord(x - radius), CellCoord(y - radius), CellCoord(x + radius), CellCoord(y + radius), true,
+		[&](const Entry &entry) {
+		float dx = entry.x - x;
+		float dy = entry.y - y;
+		if (dx * dx + dy * dy <= radius2)
+		{
+			if (count < capacity)
+			{
+				out[count] = entry.id;
+			}
+			count++;
+		}
+	});
+	return count;
+}
+
+Py_ssize_t SpatialHash::QueryRect(float x1, float y1, float x2, float y2, int *out, Py_ssize_t capacity) const
+{
+	if (x1 > x2)
+	{
+		std::swap(x1, x2);
+	}
+	if (y1 > y2)
+	{
+		std::swap(y1, y2);
+	}
+	Py_ssize_t count = 0;
+	VisitCells(CellCoord(x1), CellCoord(y1), CellCoord(x2), CellCoord(y2), true, [&](const Entry &entry) {
+		if (entry.x >= x1 && entry.x <= x2 && entry.y >= y1 && entry.y <= y2)
+		{
+			if (count < capacity)
+			{
+				out[count] = entry.id;
+			}
+			count++;
+		}
+	});
+	return count;
+}
+
+Py_ssize_t SpatialHash::QueryNearest(float x, float y, Py_ssize_t k, int *out)
+{
+	k = std::min(k, Count());
+	if (k <= 0)
+	{
+		return 0;
+	}
+	// Search rings of cells outwards, keeping the k nearest in a max-heap, until the next ring can't be nearer.
+	m_Nearest.clear();
+	int cx = CellCoord(x);
+	int cy = CellCoord(y);
+	auto visit = [&](const Entry &entry) {
+		float dx = entry.x - x;
+		float dy = entry.y - y;
+		float distance2 = dx * dx + dy * dy;
+		if (std::isnan(distance2))
+		{
+			// Keep the heap ordered.  NaN positions sort last.
+			distance2 = INFINITY;
+		}
+		if ((Py_ssize_t)m_Nearest.size() < k)
+		{
+			m_Nearest.emplace_back(distance2, entry.id);
+			std::push_heap(m_Nearest.begin(), m_Nearest.end());
+		}
+		else if (distance2 < m_Nearest.front().first)
+		{
+			std::pop_heap(m_Nearest.begin(), m_Nearest.end());
+			m_Nearest.back() = std::make_pair(distance2, entry.id);
+			std::push_heap(m_Nearest.begin(), m_Nearest.end());
+		}
+	};
+	// Rings closer than the nearest cell that has held entries are empty.
+	int firstRing = std::max({ 0, m_MinX - cx, cx - m_MaxX, m_MinY - cy, cy - m_MaxY });
+	for (int ring = firstRing; ; ring++)
+	{
+		if (ring > 0 && (double)ring * 8 > (double)m_Entries.size())
+		{
+			// Looking up the ring's cells would cost more than checking every entry.
+			m_Nearest.clear();
+			for (const Entry &entry : m_Entries)
+			{
+				visit(entry);
+			}
+			break;
+		}
+		if (ring == 0)
+		{
+			VisitCells(cx, cy, cx, cy, false, visit);
+		}
+		else
+		{
+			VisitCells(cx - ring, cy - ring, cx + ring, cy - ring, false, visit);
+			VisitCells(cx - ring, cy + ring, cx + ring, cy + ring, false, visit);
+			VisitCells(cx - ring, cy - ring + 1, cx - ring, cy + ring - 1, false, visit);
+			VisitCells(cx + ring, cy - ring + 1, cx + ring, cy + ring - 1, false, visit);
+		}
+		// Anything outside the searched rings is at least ring cells away.
+		float reach = ring * m_CellSize;
+		if ((Py_ssize_t)m_Nearest.size() == k && m_Nearest.front().first <= reach * reach)
+		{
+			break;
+		}
+		if (cx - ring <= m_MinX && cy - ring <= m_MinY && cx + ring >= m_MaxX && cy + ring >= m_MaxY)
+		{
+			break;
+		}
+	}
+	std::sort_heap(m_Nearest.begin(), m_Nearest.end());
+	for (Py_ssize_t index = 0; index < k; index++)
+	{
+		out[index] = m_Nearest[index].second;
+	}
+	return k;
+}
+
+/*
+agk.SpatialHash
+*/
+struct SpatialHashObject
+{
+	PyObject_HEAD
+	SpatialHash *grid;
+};
+
+static PyObject *SpatialHash_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+	float cellSize;
+	if (!PyArg_ParseTuple(args, "f:SpatialHash", &cellSize))
+	{
+		return NULL;
+	}
+	if (!(cellSize > 0))
+	{
+		PyErr_SetString(PyExc_ValueError, "agk.SpatialHash: cell_size must be greater than 0.");
+		return NULL;
+	}
+	SpatialHashObject *self = (SpatialHashObject *)type->tp_alloc(type, 0);
+	if (self != NULL)
+	{
+		self->grid = new SpatialHash(cellSize);
+	}
+	return (PyObject *)self;
+}
+
+static void SpatialHash_dealloc(SpatialHashObject *self)
+{
+	delete self->grid;
+	PyTypeObject *type = Py_TYPE(self);
+	type->tp_free(self);
+	Py_DECREF(type);
+}
+
+static Py_ssize_t SpatialHash_length(SpatialHashObject *self)
+{
+	return self->grid->Count();
+}
+
+/*
+Sets the IDs' positions from buffers, or from their sprites when xs and ys are omitted.  With replace, the hash is
+cleared first once the arguments have been checked.
+*/
+static bool SetPositions(SpatialHash *grid, PyObject *args, const char *function, bool replace)
+{
+	PyObject *idsArg;
+	PyObject *xsArg = NULL;
+	PyObject *ysArg = NULL;
+	if (!PyArg_ParseTuple(args, "O|OO", &idsArg, &xsArg, &ysArg))
+	{
+		return false;
+	}
+	if (xsArg != NULL && ysArg == NULL)
+	{
+		PyErr_Format(PyExc_TypeError, "agk.%s takes either ids or ids, xs and ys.", function);
+		return false;
+	}
+	BufferArg ids;
+	if (!ids.Get(idsArg, 'i', false, function, 0))
+	{
+		return false;
+	}
+	const int *idValues = (const int *)ids.data;
+	if (xsArg == NULL)
+	{
+		if (!IsMainThread())
+		{
+			PyErr_Format(PyExc_RuntimeError, "agk.%s can only read sprites from the AGK main thread.", function);
+			return false;
+		}
+		if (replace)
+		{
+			grid->Clear();
+			grid->Reserve((size_t)ids.count);
+		}
+		for (Py_ssize_t index = 0; index < ids.count; index++)
+		{
+			unsigned int sprite = (unsigned int)idValues[index];
+			grid->Set(idValues[index], agk::GetSpriteXByOffset(sprite), agk::GetSpriteYByOffset(sprite));
+		}
+		return true;
+	}
+	FloatArg xs, ys;
+	if (!xs.Get(xsArg, function, 1) || !ys.Get(ysArg, function, 2)
+		|| !CheckBatchCount(function, 1, xs.count, ids.count) || !CheckBatchCount(function, 2, ys.count, ids.count))
+	{
+		return false;
+	}
+	if (replace)
+	{
+		grid->Clear();
+		grid->Reserve((size_t)ids.count);
+	}
+	for (Py_ssize_t index = 0; index < ids.count; index++)
+	{
+		grid->Set(idValues[index], xs[index], ys[index]);
+	}
+	return true;
+}
+
+static PyObject *SpatialHash_rebuild(SpatialHashObject *self, PyObject *args)
+{
+	if (!SetPositions(self->grid, args, "SpatialHash.rebuild", true))
+	{
+		return NULL;
+	}
+	Py_RETURN_NONE;
+}
+
+static PyObject *SpatialHash_update(SpatialHashObject *self, PyObject *args)
+{
+	if (!SetPositions(self->grid, args, "SpatialHash.update", false))
+	{
+		return NULL;
+	}
+	Py_RETURN_NONE;
+}
+
+static PyObject *SpatialHash_remove(SpatialHashObject *self, PyObject *idsArg)
+{
+	BufferArg ids;
+	if (!ids.Get(idsArg, 'i', false, "SpatialHash.remove", 0))
+	{
+		return NULL;
+	}
+	const int *idValues = (const int *)ids.data;
+	int removed = 0;
+	for (Py_ssize_t index = 0; index < ids.count; index++)
+	{
+		removed += self->grid->Remove(idValues[index]);
+	}
+	return PyLong_FromLong(removed);
+}
+
+static PyObject *SpatialHash_clear(SpatialHashObject *self, PyObject *unused)
+{
+	self->grid->Clear();
+	Py_RETURN_NONE;
+}
+
+static PyObject *SpatialHash_query_radius(SpatialHashObject *self, PyObject *args)
+{
+	float x, y, radius;
+	PyObject *outArg;
+	BufferArg out;
+	if (!PyArg_ParseTuple(args, "fffO:query_radius", &x, &y, &radius, &outArg)
+		|| !out.Get(outArg, 'i', true, "SpatialHash.query_radius", 3))
+	{
+		return NULL;
+	}
+	return PyLong_FromSsize_t(self->grid->QueryRadius(x, y, radius, (int *)out.data, out.count));
+}
+
+static PyObject *SpatialHash_query_rect(SpatialHashObject *self, PyObject *args)
+{
+	float x1, y1, x2, y2;
+	PyObject *outArg;
+	BufferArg out;
+	if (!PyArg_ParseTuple(args, "ffffO:query_rect", &x1, &y1, &x2, &y2, &outArg)
+		|| !out.Get(outArg, 'i', true, "SpatialHash.query_rect", 4))
+	{
+		return NULL;
+	}
+	return PyLong_FromSsize_t(self->grid->QueryRect(x1, y1, x2, y2, (int *)out.data, out.count));
+}
+
+static PyObject *SpatialHash_query_nearest(SpatialHashObject *self, PyObject *args)
+{
+	float x, y;
+	Py_ssize_t k;
+	PyObject *outArg;
+	BufferArg out;
+	if (!PyArg_ParseTuple(args, "ffnO:query_nearest", &x, &y, &k, &outArg)
+		|| !out.Get(outArg, 'i', true, "SpatialHash.query_nearest", 3))
+	{
+		return NULL;
+	}
+	return PyLong_FromSsize_t(self->grid->QueryNearest(x, y, std::min(k, out.count), (int *)out.data));
+}
+
+static PyMethodDef SpatialHashMethods[] = {
+	{ "rebuild", (PyCFunction)SpatialHash_rebuild, METH_VARARGS,
+		"rebuild(ids, xs=None, ys=None)\n\nReplaces the contents.  Without xs and ys, the IDs are sprites and their positions are read." },
+	{ "update", (PyCFunction)SpatialHash_update, METH_VARARGS,
+		"update(ids, xs=None, ys=None)\n\nInserts or moves the given IDs.  Without xs and ys, the IDs are sprites and their positions are read." },
+	{ "remove", (PyCFunction)SpatialHash_remove, METH_O, "remove(ids)\n\nRemoves the given IDs.  Returns how many were present." },
+	{ "clear", (PyCFunction)SpatialHash_clear, METH_NOARGS, "clear()\n\nRemoves everything." },
+	{ "query_radius", (PyCFunction)SpatialHash_query_radius, METH_VARARGS,
+		"query_radius(x, y, radius, out)\n\nWrites the IDs within radius to out.  Returns the number of matches, which can be more than out holds." },
+	{ "query_rect", (PyCFunction)SpatialHash_query_rect, METH_VARARGS,
+		"query_rect(x1, y1, x2, y2, out)\n\nWrites the IDs inside the rectangle to out.  Returns the number of matches, which can be more than out holds." },
+	{ "query_nearest", (PyCFunction)SpatialHash_query_nearest, METH_VARARGS,
+		"query_nearest(x, y, k, out)\n\nWrites the k nearest IDs to out, nearest first.  Returns how many were written." },
+	{ NULL, NULL, 0, NULL }
+};
+
+static PyType_Slot SpatialHashSlots[] = {
+	{ Py_tp_new, (void *)SpatialHash_new },
+	{ Py_tp_dealloc, (void *)SpatialHash_dealloc },
+	{ Py_tp_methods, (void *)SpatialHashMethods },
+	{ Py_sq_length, (void *)SpatialHash_length },
+	{ Py_tp_doc, (void *)"SpatialHash(cell_size)\n\nA 2D spatial hash of IDs for radius, rectangle and nearest queries." },
+	{ 0, NULL }
+};
+
+static PyType_Spec SpatialHashSpec = {
+	"agk.SpatialHash", sizeof(SpatialHashObject), 0, Py_TPFLAGS_DEFAULT, SpatialHashSlots
+};
+
+int AddSpatialHashType(PyObject *module)
+{
+	PyObject *type = PyType_FromSpec(&SpatialHashSpec);
+	if (type == NULL)
+	{
+		return -1;
+	}
+	// PyModule_AddObject steals the reference.
+	if (PyModule_AddObject(module, "SpatialHash", type) == -1)
+	{
+		Py_DECREF(type);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+AGK commands.
+*/
+
+// Returns the spatial hash for a handle or reports an error and returns NULL.  Null handles are reported here rather
+// than with REQUIRED_HANDLE so that each command returns its own error value for them.
+static SpatialHash *GetSpatialHash(int hgrid, const char *caller)
+{
+	PyObject *object = GetAgkObject(hgrid, (destructor)SpatialHash_dealloc, "SpatialHash", caller);
+	return (object) ? ((SpatialHashObject *)object)->grid : NULL;
+}
+
+/*
+Creates an agk.SpatialHash and returns its handle.  Py_DECREF it when done.
+*/
+int PySpatialHash_New(float cellSize)
+{
+	HOLD_GIL
+	return NewAgkObject("SpatialHash", Py_BuildValue("(f)", cellSize));
+}
+
+/*
+Replaces the contents with the sprites whose IDs are in a memblock of 32-bit integers.  Returns -1 on error.
+*/
+int PySpatialHash_RebuildFromSprites(int hgrid, int memID, int offset, int count)
+{
+	HOLD_GIL
+	SpatialHash *grid = GetSpatialHash(hgrid, __FUNCTION__);
+	const int *ids = (const int *)GetMemblockArray(memID, offset, count, (int)sizeof(int));
+	if (grid == NULL || ids == NULL)
+	{
+		return -1;
+	}
+	grid->Clear();
+	grid->Reserve(count);
+	for (int index = 0; index < count; index++)
+	{
+		grid->Set(ids[index], agk::GetSpriteXByOffset(ids[index]), agk::GetSpriteYByOffset(ids[index]));
+	}
+	return count;
+}
+
+/*
+Inserts or moves the sprites whose IDs are in a memblock of 32-bit integers.  Returns -1 on error.
+*/
+int PySpatialHash_UpdateFromSprites(int hgrid, int memID, int offset, int count)
+{
+	HOLD_GIL
+	SpatialHash *grid = GetSpatialHash(hgrid, __FUNCTION__);
+	const int *ids = (const int *)GetMemblockArray(memID, offset, count, (int)sizeof(int));
+	if (grid == NULL || ids == NULL)
+	{
+		return -1;
+	}
+	for (int index = 0; index < count; index++)
+	{
+		grid->Set(ids[index], agk::GetSpriteXByOffset(ids[index]), agk::GetSpriteYByOffset(ids[index]));
+	}
+	return count;
+}
+
+void PySpatialHash_Set(int hgrid, int id, float x, float y)
+{
+	HOLD_GIL
+	SpatialHash *grid = GetSpatialHash(hgrid, __FUNCTION__);
+	if (grid)
+	{
+		grid->Set(id, x, y);
+	}
+}
+
+int PySpatialHash_Remove(int hgrid, int id)
+{
+	HOLD_GIL
+	SpatialHash *grid = GetSpatialHash(hgrid, __FUNCTION__);
+	return (grid) ? grid->Remove(id) : 0;
+}
+
+void PySpatialHash_Clear(int hgrid)
+{
+	HOLD_GIL
+	SpatialHash *grid = GetSpatialHash(hgrid, __FUNCTION__);
+	if (grid)
+	{
+		grid->Clear();
+	}
+}
+
+int PySpatialHash_GetCount(int hgrid)
+{
+	HOLD_GIL
+	SpatialHash *grid = GetSpatialHash(hgrid, __FUNCTION__);
+	return (grid) ? (int)grid->Count() : 0;
+}
+
+/*
+The queries write IDs into a memblock as 32-bit integers, up to maxCount of them.  QueryRadius and QueryRect return
+the number of matches, which can be more than maxCount.  QueryNearest returns how many IDs it wrote.
+All return -1 on error.
+*/
+int PySpatialHash_QueryRadius(int hgrid, float x, float y, float radius, int memID, int offset, int maxCount)
+{
+	HOLD_GIL
+	SpatialHash *grid = GetSpatialHash(hgrid, __FUNCTION__);
+	int *out = (int *)GetMemblockArray(memID, offset, maxCount, (int)sizeof(int));
+	if (grid == NULL || out == NULL)
+	{
+		return -1;
+	}
+	return (int)grid->QueryRadius(x, y, radius, out, maxCount);
+}
+
+int PySpatialHash_QueryRect(int hgrid, float x1, float y1, float x2, float y2, int memID, int offset, int maxCount)
+{
+	HOLD_GIL
+	SpatialHash *grid = GetSpatialHash(hgrid, __FUNCTION__);
+	int *out = (int *)GetMemblockArray(memID, offset, maxCount, (int)sizeof(int));
+	if (grid == NULL || out == NULL)
+	{
+		return -1;
+	}
+	return (int)grid->QueryRect(x1, y1, x2, y2, out, maxCount);
+}
+
+int PySpatialHash_QueryNearest(int hgrid, float x, float y, int k, int memID, int offset)
+{
+	HOLD_GIL
+	SpatialHash *grid = GetSpatialHash(hgrid, __FUNCTION__);
+	int *out = (int *)GetMemblockArray(memID, offset, k, (int)sizeof(int));
+	if (grid == NULL || out == NULL)
+	{
+		return -1;
+	}
+	return (int)grid->QueryNearest(x, y, k, out);
+}
@@ -0,0 +1,217 @@
+/*
+Copyright (c) 2017 Adam Biser <adambiser@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+Batch sprite commands for the agk module.
+
+Each command takes a buffer of sprite IDs and applies one AGK command to all of them in a native loop, so moving
+20000 bullets is one Python call instead of 20000:
+
+	ids = array.array('i', bullets)
+	xs = array.array('f', ...)
+	ys = array.array('f', ...)
+	agk.SetSpritePositions(ids, xs, ys)
+	agk.SetSpriteAngles(ids, 90.0)			# A number applies to every sprite.
+	agk.GetSpritePositions(ids, xs, ys)		# Getters write into writable buffers.
+
+IDs are 32-bit integers, values are 32-bit floats and colors are 4 bytes per sprite: red, green, blue, alpha.
+Value buffers can be longer than the ID buffer but not shorter.
+*/
+
+#include "AgkModule.h"
+#include "PythonPlugin.h"
+#include "PythonThreading.h"
+#include "PluginHelpers.h"
+#ifdef PLUGIN
+#include "..\AGKLibraryCommands.h"
+#endif
+
+AGK_THUNK(SetSpritePositions)
+{
+	AGK_BEGIN(SetSpritePositions, 3, 3)
+	BufferArg ids;
+	FloatArg xs, ys;
+	if (!ids.Get(args[0], 'i', false, "SetSpritePositions", 0) || !xs.Get(args[1], "SetSpritePositions", 1)
+		|| !ys.Get(args[2], "SetSpritePositions", 2)
+		|| !CheckBatchCount("SetSpritePositions", 1, xs.count, ids.count)
+		|| !CheckBatchCount("SetSpritePositions", 2, ys.count, ids.count))
+	{
+		return NULL;
+	}
+	const unsigned int *spriteIDs = (const unsigned int *)ids.data;
+	for (Py_ssize_t index = 0; index < ids.count; index++)
+	{
+		agk::SetSpritePosition(spriteIDs[index], xs[index], ys[index]);
+	}
+	Py_RETURN_NONE;
+}
+
+AGK_THUNK(SetSpriteAngles)
+{
+	AGK_BEGIN(SetSpriteAngles, 2, 2)
+	BufferArg ids;
+	FloatArg angles;
+	if (!ids.Get(args[0], 'i', false, "SetSpriteAngles", 0) || !angles.Get(args[1], "SetSpriteAngles", 1)
+		|| !CheckBatchCount("SetSpriteAngles", 1, angles.count, ids.count))
+	{
+		return NULL;
+	}
+	const unsigned int *spriteIDs = (const unsigned int *)ids.data;
+	for (Py_ssize_t index = 0; index < ids.count; index++)
+	{
+		agk::SetSpriteAngle(spriteIDs[index], angles[index]);
+	}
+	Py_RETURN_NONE;
+}
+
+AGK_THUNK(SetSpriteScales)
+{
+	AGK_BEGIN(SetSpriteScales, 3, 3)
+	BufferArg ids;
+	FloatArg xs, ys;
+	if (!ids.Get(args[0], 'i', false, "SetSpriteScales", 0) || !xs.Get(args[1], "SetSpriteScales", 1)
+		|| !ys.Get(args[2], "SetSpriteScales", 2)
+		|| !CheckBatchCount("SetSpriteScales", 1, xs.count, ids.count)
+		|| !CheckBatchCount("SetSpriteScales", 2, ys.count, ids.count))
+	{
+		return NULL;
+	}
+	const unsigned int *spriteIDs = (const unsigned int *)ids.data;
+	for (Py_ssize_t index = 0; index < ids.count; index++)
+	{
+		agk::SetSpriteScale(spriteIDs[index], xs[index], ys[index]);
+	}
+	Py_RETURN_NONE;
+}
+
+AGK_THUNK(SetSpriteColors)
+{
+	AGK_BEGIN(SetSpriteColors, 2, 2)
+	BufferArg ids, colors;
+	if (!ids.Get(args[0], 'i', false, "SetSpriteColors", 0) || !colors.Get(args[1], 'B', false, "SetSpriteColors", 1)
+		|| !CheckBatchCount("SetSpriteColors", 1, colors.count / 4, ids.count))
+	{
+		return NULL;
+	}
+	const unsigned int *spriteIDs = (const unsigned int *)ids.data;
+	const unsigned char *rgba = (const unsigned char *)colors.data;
+	for (Py_ssize_t index = 0; index < ids.count; index++, rgba += 4)
+	{
+		agk::SetSpriteColor(spriteIDs[index], rgba[0], rgba[1], rgba[2], rgba[3]);
+	}
+	Py_RETURN_NONE;
+}
+
+AGK_THUNK(GetSpritePositions)
+{
+	AGK_BEGIN(GetSpritePositions, 3, 3)
+	BufferArg ids, xs, ys;
+	if (!ids.Get(args[0], 'i', false, "GetSpritePositions", 0) || !xs.Get(args[1], 'f', true, "GetSpritePositions", 1)
+		|| !ys.Get(args[2], 'f', true, "GetSpritePositions", 2)
+		|| !CheckBatchCount("GetSpritePositions", 1, xs.count, ids.count)
+		|| !CheckBatchCount("GetSpritePositions", 2, ys.count, ids.count))
+	{
+		return NULL;
+	}
+	const unsigned int *spriteIDs = (const unsigned int *)ids.data;
+	float *x = (float *)xs.data;
+	float *y = (float *)ys.data;
+	for (Py_ssize_t index = 0; index < ids.count; index++)
+	{
+		x[index] = agk::GetSpriteX(spriteIDs[index]);
+		y[index] = agk::GetSpriteY(spriteIDs[index]);
+	}
+	Py_RETURN_NONE;
+}
+
+AGK_THUNK(GetSpriteAngles)
+{
+	AGK_BEGIN(GetSpriteAngles, 2, 2)
+	BufferArg ids, angles;
+	if (!ids.Get(args[0], 'i', false, "GetSpriteAngles", 0) || !angles.Get(args[1], 'f', true, "GetSpriteAngles", 1)
+		|| !CheckBatchCount("GetSpriteAngles", 1, angles.count, ids.count))
+	{
+		return NULL;
+	}
+	const unsigned int *spriteIDs = (const unsigned int *)ids.data;
+	float *angle = (float *)angles.data;
+	for (Py_ssize_t index = 0; index < ids.count; index++)
+	{
+		angle[index] = agk::GetSpriteAngle(spriteIDs[index]);
+	}
+	Py_RETURN_NONE;
+}
+
+AGK_THUNK(GetSpriteScales)
+{
+	AGK_BEGIN(GetSpriteScales, 3, 3)
+	BufferArg ids, xs, ys;
+	if (!ids.Get(args[0], 'i', false, "GetSpriteScales", 0) || !xs.Get(args[1], 'f', true, "GetSpriteScales", 1)
+		|| !ys.Get(args[2], 'f', true, "GetSpriteScales", 2)
+		|| !CheckBatchCount("GetSpriteScales", 1, xs.count, ids.count)
+		|| !CheckBatchCount("GetSpriteScales", 2, ys.count, ids.count))
+	{
+		return NULL;
+	}
+	const unsigned int *spriteIDs = (const unsigned int *)ids.data;
+	float *x = (float *)xs.data;
+	float *y = (float *)ys.data;
+	for (Py_ssize_t index = 0; index < ids.count; index++)
+	{
+		x[index] = agk::GetSpriteScaleX(spriteIDs[index]);
+		y[index] = agk::GetSpriteScaleY(spriteIDs[index]);
+	}
+	Py_RETURN_NONE;
+}
+
+AGK_THUNK(GetSpriteColors)
+{
+	AGK_BEGIN(GetSpriteColors, 2, 2)
+	BufferArg ids, colors;
+	if (!ids.Get(args[0], 'i', false, "GetSpriteColors", 0) || !colors.Get(args[1], 'B', true, "GetSpriteColors", 1)
+		|| !CheckBatchCount("GetSpriteColors", 1, colors.count / 4, ids.count))
+	{
+		return NULL;
+	}
+	const unsigned int *spriteIDs = (const unsigned int *)ids.data;
+	unsigned char *rgba = (unsigned char *)colors.data;
+	for (Py_ssize_t index = 0; index < ids.count; index++, rgba += 4)
+	{
+		rgba[0] = (unsigned char)agk::GetSpriteColorRed(spriteIDs[index]);
+		rgba[1] = (unsigned char)agk::GetSpriteColorGreen(spriteIDs[index]);
+		rgba[2] = (unsigned char)agk::GetSpriteColorBlue(spriteIDs[index]);
+		rgba[3] = (unsigned char)agk::GetSpriteColorAlpha(spriteIDs[index]);
+	}
+	Py_RETURN_NONE;
+}
+
+PyMethodDef SpriteBatchMethods[] = {
+	AGK_METHOD(SetSpritePositions, "SetSpritePositions(ids, xs, ys)"),
+	AGK_METHOD(SetSpriteAngles, "SetSpriteAngles(ids, angles)"),
+	AGK_METHOD(SetSpriteScales, "SetSpriteScales(ids, xs, ys)"),
+	AGK_METHOD(SetSpriteColors, "SetSpriteColors(ids, rgba)"),
+	AGK_METHOD(GetSpritePositions, "GetSpritePositions(ids, xs, ys)"),
+	AGK_METHOD(GetSpriteAngles, "GetSpriteAngles(ids, angles)"),
+	AGK_METHOD(GetSpriteScales, "GetSpriteScales(ids, xs, ys)"),
+	AGK_METHOD(GetSpriteColors, "GetSpriteColors(ids, rgba)"),
+	{ NULL, NULL, 0, NULL }
+};
@@ -0,0 +1,321 @@
+/*
+Copyright (c) 2017 Adam Biser <adambiser@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+Batch tweens for the agk module.
+
+PlayTweenSprites and PlayTweenTexts create and play tweens from a list of specs in one call, instead of
+CreateTweenSprite, a SetTweenSprite* call per property and PlayTweenSprite for each:
+
+	agk.PlayTweenSprites([
+		(sprite, "X", 0, 500, 1.0, "Smooth1"),
+		(sprite, "Alpha", 0, 255, 1.0, "Linear"),
+		(other, "Angle", 0, 360, 2.0, agk.TweenBounce(), 0.5),		# Optional delay in seconds.
+	])
+
+A spec is (target, property, start, end, duration, easing[, delay]).  Properties are the endings of the
+SetTweenSprite* and SetTweenText* commands, such as "X", "YByOffset", "SizeX" or "Alpha".  Easing is a Tween*()
+value or its name without "Tween".
+
+Consecutive specs with the same target, duration and delay share one tween unless one sets a property again.  All
+specs are checked before anything is created.  Returns the list of tween IDs, which are not deleted automatically.
+With chain=True, each spec gets its own tween, the tweens are added to a new tween chain in order, each starting after
+the previous one plus its delay, and the chain ID is returned instead.
+*/
+
+#include <cstring>
+#include <vector>
+
+#include "AgkModule.h"
+#include "PythonPlugin.h"
+#include "PythonThreading.h"
+#include "PluginHelpers.h"
+#ifdef PLUGIN
+#include "..\AGKLibraryCommands.h"
+#endif
+
+typedef void (*SetTweenFloat)(unsigned int tweenID, float begin, float end, int interpolation);
+typedef void (*SetTweenInt)(unsigned int tweenID, int begin, int end, int interpolation);
+
+struct TweenProperty
+{
+	const char *name;
+	SetTweenFloat setFloat;
+	SetTweenInt setInt;
+};
+
+static const TweenProperty SpriteProperties[] = {
+	{ "X", agk::SetTweenSpriteX, NULL },
+	{ "Y", agk::SetTweenSpriteY, NULL },
+	{ "XByOffset", agk::SetTweenSpriteXByOffset, NULL },
+	{ "YByOffset", agk::SetTweenSpriteYByOffset, NULL },
+	{ "Angle", agk::SetTweenSpriteAngle, NULL },
+	{ "SizeX", agk::SetTweenSpriteSizeX, NULL },
+	{ "SizeY", agk::SetTweenSpriteSizeY, NULL },
+	{ "Red", NULL, agk::SetTweenSpriteRed },
+	{ "Green", NULL, agk::SetTweenSpriteGreen },
+	{ "Blue", NULL, agk::SetTweenSpriteBlue },
+	{ "Alpha", NULL, agk::SetTweenSpriteAlpha },
+	{ NULL, NULL, NULL }
+};
+
+static const TweenProperty TextProperties[] = {
+	{ "X", agk::SetTweenTextX, NULL },
+	{ "Y", agk::SetTweenTextY, NULL },
+	{ "Angle", agk::SetTweenTextAngle, NULL },
+	{ "Size", agk::SetTweenTextSize, NULL },
+	{ "Spacing", agk::SetTweenTextSpacing, NULL },
+	{ "LineSpacing", agk::SetTweenTextLineSpacing, NULL },
+	{ "Red", NULL, agk::SetTweenTextRed },
+	{ "Green", NULL, agk::SetTweenTextGreen },
+	{ "Blue", NULL, agk::SetTweenTextBlue },
+	{ "Alpha", NULL, agk::SetTweenTextAlpha },
+	{ NULL, NULL, NULL }
+};
+
+struct TweenEasing
+{
+	const char *name;
+	int (*get)();
+};
+
+static const TweenEasing Easings[] = {
+	{ "Linear", agk::TweenLinear },
+	{ "Smooth1", agk::TweenSmooth1 },
+	{ "Smooth2", agk::TweenSmooth2 },
+	{ "EaseIn1", agk::TweenEaseIn1 },
+	{ "EaseIn2", agk::TweenEaseIn2 },
+	{ "EaseOut1", agk::TweenEaseOut1 },
+	{ "EaseOut2", agk::TweenEaseOut2 },
+	{ "Bounce", agk::TweenBounce },
+	{ "Overshoot", agk::TweenOvershoot },
+	{ NULL, NULL }
+};
+
+// How to create and play one kind of tween.
+struct TweenKind
+{
+	const char *function;
+	const TweenProperty *properties;
+	unsigned int (*create)(float duration);
+	void (*play)(unsigned int tweenID, unsigned int targetID, float delay);
+	void (*addToChain)(unsigned int chainID, unsigned int tweenID, unsigned int targetID, float delay);
+};
+
+static const TweenKind SpriteTweens = {
+	"PlayTweenSprites", SpriteProperties, agk::CreateTweenSprite, agk::PlayTweenSprite, agk::AddTweenChainSprite
+};
+
+static const TweenKind TextTweens = {
+	"PlayTweenTexts", TextProperties, agk::CreateTweenText, agk::PlayTweenText, agk::AddTweenChainText
+};
+
+struct TweenSpec
+{
+	unsigned int target;
+	const TweenProperty *property;
+	float begin, end;
+	float duration;
+	int easing;
+	float delay;
+};
+
+static bool GetEasing(PyObject *arg, int &easing, const char *function, Py_ssize_t index)
+{
+	if (!PyUnicode_Check(arg))
+	{
+		return ToInt(arg, easing);
+	}
+	const char *name = PyUnicode_AsUTF8(arg);
+	if (name == NULL)
+	{
+		return false;
+	}
+	for (const TweenEasing *entry = Easings; entry->name; entry++)
+	{
+		if (strcmp(entry->name, name) == 0)
+		{
+			easing = entry->get();
+			return true;
+		}
+	}
+	PyErr_Format(PyExc_ValueError, "agk.%s: Spec %zd has an unknown easing '%s'.", function, index, name);
+	return false;
+}
+
+static bool GetSpec(const TweenKind &kind, PyObject *arg, TweenSpec &spec, Py_ssize_t index)
+{
+	PyObject *fields = PySequence_Fast(arg, "");
+	if (fields == NULL || PySequence_Fast_GET_SIZE(fields) < 6 || PySequence_Fast_GET_SIZE(fields) > 7)
+	{
+		PyErr_Format(PyExc_TypeError,
+			"agk.%s: Spec %zd must be (target, property, start, end, duration, easing[, delay]).", kind.function, index);
+		Py_XDECREF(fields);
+		return false;
+	}
+	PyObject **items = PySequence_Fast_ITEMS(fields);
+	const char *name = NULL;
+	if (PyUnicode_Check(items[1]))
+	{
+		name = PyUnicode_AsUTF8(items[1]);
+		if (name == NULL)
+		{
+			Py_DECREF(fields);
+			return false;
+		}
+	}
+	spec.property = NULL;
+	for (const TweenProperty *property = kind.properties; name && property->name; property++)
+	{
+		if (strcmp(property->name, name) == 0)
+		{
+			spec.property = property;
+			break;
+		}
+	}
+	spec.delay = 0;
+	bool ok = ToUInt(items[0], spec.target) && ToFloat(items[2], spec.begin) && ToFloat(items[3], spec.end)
+		&& ToFloat(items[4], spec.duration) && GetEasing(items[5], spec.easing, kind.function, index)
+		&& (PySequence_Fast_GET_SIZE(fields) == 6 || ToFloat(items[6], spec.delay));
+	if (ok && spec.property == NULL)
+	{
+		PyErr_Format(PyExc_ValueError, "agk.%s: Spec %zd has an unknown property %R.", kind.function, index, items[1]);
+		ok = false;
+	}
+	Py_DECREF(fields);
+	return ok;
+}
+
+// Whether specs[index] can be added to the tween of specs[first] to specs[index - 1].
+static bool SharesTween(const std::vector<TweenSpec> &specs, Py_ssize_t first, Py_ssize_t index)
+{
+	const TweenSpec &spec = specs[index];
+	if (spec.target != specs[first].target || spec.duration != specs[first].duration || spec.delay != specs[first].delay)
+	{
+		return false;
+	}
+	for (Py_ssize_t other = first; other < index; other++)
+	{
+		if (specs[other].property == spec.property)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static PyObject *PlayTweens(const TweenKind &kind, PyObject *const *args, Py_ssize_t nargs)
+{
+	int chain = 0;
+	if (nargs == 2)
+	{
+		chain = PyObject_IsTrue(args[1]);
+		if (chain == -1)
+		{
+			return NULL;
+		}
+	}
+	PyObject *specList = PySequence_Fast(args[0], "");
+	if (specList == NULL)
+	{
+		PyErr_Format(PyExc_TypeError, "agk.%s: specs must be a sequence.", kind.function);
+		return NULL;
+	}
+	Py_ssize_t count = PySequence_Fast_GET_SIZE(specList);
+	std::vector<TweenSpec> specs((size_t)count);
+	for (Py_ssize_t index = 0; index < count; index++)
+	{
+		if (!GetSpec(kind, PySequence_Fast_GET_ITEM(specList, index), specs[index], index))
+		{
+			Py_DECREF(specList);
+			return NULL;
+		}
+	}
+	Py_DECREF(specList);
+	PyObject *tweenIDs = (chain) ? NULL : PyList_New(0);
+	if (!chain && tweenIDs == NULL)
+	{
+		return NULL;
+	}
+	unsigned int chainID = (chain) ? agk::CreateTweenChain() : 0;
+	for (Py_ssize_t first = 0; first < count;)
+	{
+		const TweenSpec &group = specs[first];
+		unsigned int tweenID = kind.create(group.duration);
+		Py_ssize_t last = first + 1;
+		while (!chain && last < count && SharesTween(specs, first, last))
+		{
+			last++;
+		}
+		for (Py_ssize_t index = first; index < last; index++)
+		{
+			const TweenSpec &spec = specs[index];
+			if (spec.property->setFloat)
+			{
+				spec.property->setFloat(tweenID, spec.begin, spec.end, spec.easing);
+			}
+			else
+			{
+				spec.property->setInt(tweenID, (int)spec.begin, (int)spec.end, spec.easing);
+			}
+		}
+		first = last;
+		if (chain)
+		{
+			kind.addToChain(chainID, tweenID, group.target, group.delay);
+			continue;
+		}
+		kind.play(tweenID, group.target, group.delay);
+		PyObject *id = PyLong_FromUnsignedLong(tweenID);
+		if (id == NULL || PyList_Append(tweenIDs, id) == -1)
+		{
+			Py_XDECREF(id);
+			Py_DECREF(tweenIDs);
+			return NULL;
+		}
+		Py_DECREF(id);
+	}
+	if (chain)
+	{
+		agk::PlayTweenChain(chainID);
+		return PyLong_FromUnsignedLong(chainID);
+	}
+	return tweenIDs;
+}
+
+AGK_THUNK(PlayTweenSprites)
+{
+	AGK_BEGIN(PlayTweenSprites, 1, 2)
+	return PlayTweens(SpriteTweens, args, nargs);
+}
+
+AGK_THUNK(PlayTweenTexts)
+{
+	AGK_BEGIN(PlayTweenTexts, 1, 2)
+	return PlayTweens(TextTweens, args, nargs);
+}
+
+PyMethodDef TweenBatchMethods[] = {
+	AGK_METHOD(PlayTweenSprites, "PlayTweenSprites(specs, chain=False) -> list or int"),
+	AGK_METHOD(PlayTweenTexts, "PlayTweenTexts(specs, chain=False) -> list or int"),
+	{ NULL, NULL, 0, NULL }
+};
@@ -0,0 +1,303 @@
+/*
+Copyright (c) 2017 Adam Biser <adambiser@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+Script watchdog.
+
+PyWatchdog_SetBudget puts a time limit on every plugin call from the AGK main thread.  A watchdog thread sleeps
+until the running call's deadline and, if the call is still going, asks Python to raise agk.BudgetExceededError in
+the main thread with Py_AddPendingCall.  The error unwinds the script like any other and CheckError reports it, so a
+runaway _PyRun_String or _PyObject_Call returns to AGK instead of freezing the game.
+
+BudgetExceededError derives from BaseException, so "except Exception:" does not swallow it.  If a script catches it
+anyway, it is raised again every quarter of the budget (at most every millisecond) until the call returns.
+
+Python only runs pending calls between bytecodes of the main interpreter, so a single long-running C function
+(sum(range(10**10)), time.sleep, etc.) is interrupted when it returns, and code running in a sub-interpreter is not
+interrupted at all.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "AgkModule.h"
+#include "PythonPlugin.h"
+#include "PythonErrorHandling.h"
+#include "PythonThreading.h"
+#include "PluginHelpers.h"
+#include <frameobject.h>
+#ifdef PLUGIN
+#include "..\AGKLibraryCommands.h"
+#endif
+
+// 0 when the watchdog is disabled.
+std::atomic<long long> m_WatchdogBudgetNS(0);
+// Start time of the main thread's current call, 0 when it is not in a call.
+std::atomic<long long> m_WatchdogCallStart(0);
+// Bumped for every call so that a late interrupt can't hit the next one.
+std::atomic<unsigned int> m_WatchdogCallSerial(0);
+
+std::thread m_WatchdogThread;
+std::mutex m_WatchdogMutex;
+std::condition_variable m_WatchdogWake;
+bool m_WatchdogStop = false;
+
+// The rest is only used by the main thread while it holds the GIL.
+PyObject *m_WatchdogError = NULL;
+unsigned int m_WatchdogLastSerial = 0;
+int m_WatchdogTimeoutCount = 0;
+std::string m_WatchdogLastLocation;
+std::map<std::string, int> m_WatchdogLocations;
+
+static long long WatchdogNow()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void WatchdogEnterCall()
+{
+	if (m_WatchdogBudgetNS.load(std::memory_order_relaxed) == 0)
+	{
+		return;
+	}
+	m_WatchdogCallSerial.fetch_add(1, std::memory_order_relaxed);
+	m_WatchdogCallStart.store(WatchdogNow(), std::memory_order_release);
+}
+
+void WatchdogLeaveCall()
+{
+	m_WatchdogCallStart.store(0, std::memory_order_release);
+}
+
+// Returns "filename:line in function" for the innermost Python frame.
+static std::string GetCurrentLocation()
+{
+	PyFrameObject *frame = PyEval_GetFrame();
+	if (frame == NULL)
+	{
+		return "<unknown>";
+	}
+	PyCodeObject *code = frame->f_code;
+	Py_INCREF(code);
+	std::string location;
+	const char *filename = PyUnicode_AsUTF8(code->co_filename);
+	const char *name = PyUnicode_AsUTF8(code->co_name);
+	location = filename ? filename : "<unknown>";
+	location += ":" + std::to_string(PyFrame_GetLineNumber(frame));
+	location += " in ";
+	location += name ? name : "<unknown>";
+	Py_DECREF(code);
+	PyErr_Clear();
+	return location;
+}
+
+// Returns a borrowed reference to agk.BudgetExceededError, creating it if the agk module hasn't been imported yet.
+static PyObject *GetBudgetExceededError()
+{
+	if (m_WatchdogError == NULL)
+	{
+		m_WatchdogError = PyErr_NewException("agk.BudgetExceededError", PyExc_BaseException, NULL);
+	}
+	return m_WatchdogError;
+}
+
+int AddBudgetExceededError(PyObject *module)
+{
+	PyObject *error = GetBudgetExceededError();
+	if (error == NULL)
+	{
+		return -1;
+	}
+	Py_INCREF(error);
+	if (PyModule_AddObject(module, "BudgetExceededError", error) == -1)
+	{
+		Py_DECREF(error);
+		return -1;
+	}
+	return 0;
+}
+
+// Runs in the main thread between bytecodes.  arg is the serial of the call that ran out of time.
+static int RaiseBudgetExceeded(void *arg)
+{
+	unsigned int serial = (unsigned int)(uintptr_t)arg;
+	if (m_WatchdogCallStart.load(std::memory_order_acquire) == 0
+		|| m_WatchdogCallSerial.load(std::memory_order_relaxed) != serial)
+	{
+		// That call already returned.
+		return 0;
+	}
+	PyObject *error = GetBudgetExceededError();
+	if (error == NULL)
+	{
+		return -1;
+	}
+	std::string location = GetCurrentLocation();
+	if (serial != m_WatchdogLastSerial)
+	{
+		m_WatchdogLastSerial = serial;
+		m_WatchdogTimeoutCount++;
+		m_WatchdogLastLocation = location;
+		m_WatchdogLocations[location]++;
+	}
+	char message[64];
+	snprintf(message, sizeof(message), "Script exceeded its %.1f ms budget at ",
+		m_WatchdogBudgetNS.load(std::memory_order_relaxed) / 1000000.0);
+	PyErr_SetString(error, (message + location + ".").c_str());
+	return -1;
+}
+
+static void WatchdogMain()
+{
+	std::unique_lock<std::mutex> lock(m_WatchdogMutex);
+	unsigned int firedSerial = 0;
+	long long firedTime = 0;
+	while (!m_WatchdogStop)
+	{
+		long long budget = m_WatchdogBudgetNS.load(std::memory_order_relaxed);
+		if (budget == 0)
+		{
+			m_WatchdogWake.wait(lock);
+			continue;
+		}
+		long long start = m_WatchdogCallStart.load(std::memory_order_acquire);
+		unsigned int serial = m_WatchdogCallSerial.load(std::memory_order_relaxed);
+		long long now = WatchdogNow();
+		long long wait = budget;
+		if (start != 0)
+		{
+			long long deadline = start + budget;
+			if (now >= deadline)
+			{
+				long long retry = std::max(budget / 4, 1000000LL);
+				if (serial != firedSerial || now - firedTime >= retry)
+				{
+					Py_AddPendingCall(RaiseBudgetExceeded, (void *)(uintptr_t)serial);
+					// Newer Pythons don't wake the eval loop for a pending call added from another thread, but
+					// they do check pending calls when asked to hand over the GIL.
+					lock.unlock();
+					PyGILState_STATE state = PyGILState_Ensure();
+					PyGILState_Release(state);
+					lock.lock();
+					firedSerial = serial;
+					firedTime = now;
+				}
+				wait = retry;
+			}
+			else
+			{
+				wait = deadline - now;
+			}
+		}
+		m_WatchdogWake.wait_for(lock, std::chrono::nanoseconds(wait));
+	}
+}
+
+/*
+Sets the time limit for each plugin call from the main thread, in milliseconds.  0 disables the watchdog, which is
+the default.  Finalizing Python disables it again.
+*/
+void PyWatchdog_SetBudget(float budgetMS)
+{
+	if (budgetMS < 0)
+	{
+		agk::PluginError("PyWatchdog_SetBudget: The budget cannot be negative.");
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_WatchdogMutex);
+		m_WatchdogBudgetNS = (long long)(budgetMS * 1000000.0);
+		m_WatchdogStop = false;
+	}
+	if (budgetMS > 0 && !m_WatchdogThread.joinable())
+	{
+		m_WatchdogThread = std::thread(WatchdogMain);
+	}
+	m_WatchdogWake.notify_one();
+}
+
+float PyWatchdog_GetBudget()
+{
+	return (float)(m_WatchdogBudgetNS / 1000000.0);
+}
+
+// The number of calls that were interrupted.
+int PyWatchdog_GetTimeoutCount()
+{
+	return m_WatchdogTimeoutCount;
+}
+
+// Where the last interrupted call was when it ran out of time, as "filename:line in function".
+char *PyWatchdog_GetLastLocation()
+{
+	return CreateString(m_WatchdogLastLocation.c_str());
+}
+
+// One line per location that ran out of time, as "count filename:line in function", most frequent first.
+char *PyWatchdog_GetReport()
+{
+	std::multimap<int, const std::string *, std::greater<int>> sorted;
+	for (auto &location : m_WatchdogLocations)
+	{
+		sorted.emplace(location.second, &location.first);
+	}
+	std::string report;
+	for (auto &entry : sorted)
+	{
+		report += std::to_string(entry.first) + " " + *entry.second + "\n";
+	}
+	return CreateString(report.c_str());
+}
+
+void PyWatchdog_ResetStats()
+{
+	m_WatchdogTimeoutCount = 0;
+	m_WatchdogLastLocation.clear();
+	m_WatchdogLocations.clear();
+}
+
+void ShutdownWatchdog()
+{
+	// The watchdog thread may be waiting for the GIL.
+	{
+		std::lock_guard<std::mutex> lock(m_WatchdogMutex);
+		m_WatchdogStop = true;
+		m_WatchdogBudgetNS = 0;
+	}
+	m_WatchdogWake.notify_one();
+	if (m_WatchdogThread.joinable())
+	{
+		m_WatchdogThread.join();
+	}
+	m_WatchdogCallStart = 0;
+	HOLD_GIL
+	Py_CLEAR(m_WatchdogError);
+}
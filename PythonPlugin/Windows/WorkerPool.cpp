@@ -0,0 +1,974 @@
+/*
+Copyright (c) 2017 Adam Biser <adambiser@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+Multi-process worker pool.
+
+PyPool_Start launches worker processes that each run python with the given module imported.  Jobs name a function
+in that module, or "module:function" for a function in another module, and pass it one bytes argument.
+The function's return value (bytes, a buffer, str or None) is the job's result.
+
+PyPool_Map splits a memblock of fixed-size records into chunks, runs a function on every chunk across the workers
+and writes the results to another memblock.
+
+All job data lives in one shared memory block:
+
+	header		uint32 magic, worker count, slots per worker, slot size, ring offset, slot offset
+	rings		per worker: uint32 tail, uint32 head, uint32 slot index[slots per worker]
+	slots		per slot: uint32 state, function length, argument length, result length, then the data
+
+The main thread owns the free slots.  To submit a job it fills in a free slot, appends the slot index to the
+worker's ring and bumps the ring's tail.  Each ring has exactly one producer and one consumer, so no locks are needed.
+The worker writes the result over the slot's data and then sets the slot's state, which the main thread polls.
+Before a worker waits on its doorbell pipe it stores how far it has read as the ring's head, so the main thread writes
+a byte to the doorbell only when the head shows that the ring was empty before its push.
+
+Workers use struct.pack_into to update the shared memory, which relies on x86 store ordering.  Taking and releasing
+a lock is a locked instruction, which workers use as the full fence between storing the head and reading the tail.
+*/
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "PythonPlugin.h"
+#include "PythonErrorHandling.h"
+#include "PythonThreading.h"
+#include "PluginHelpers.h"
+#ifdef PLUGIN
+#include "..\AGKLibraryCommands.h"
+#endif
+
+#define POOL_MAGIC				0x4C4F4F50 // "POOL"
+#define POOL_SLOTS_PER_WORKER	16
+#define POOL_RING_HEADER		2 // tail, head
+#define POOL_SLOT_HEADER_SIZE	16
+#define POOL_MIN_SLOT_SIZE		256
+#define POOL_STOP_TIMEOUT_MS	2000
+#define POOL_MAP_TIMEOUT_MS		10000 // PyPool_Map fails when no chunk finishes for this long.
+#define POOL_DOORBELL_ARG		6 // Index of the doorbell in the worker's arguments.
+
+enum SlotState
+{
+	SLOT_FREE = 0,
+	SLOT_QUEUED = 1,
+	SLOT_RUNNING = 2,
+	SLOT_DONE = 3,
+	SLOT_FAILED = 4,
+};
+
+struct PoolHeader
+{
+	uint32_t magic;
+	uint32_t workerCount;
+	uint32_t slotsPerWorker;
+	uint32_t slotSize;
+	uint32_t ringOffset;
+	uint32_t slotOffset;
+};
+
+struct PoolSlot
+{
+	std::atomic<uint32_t> state;
+	uint32_t functionLength;
+	uint32_t argumentLength;
+	uint32_t resultLength;
+	char data[1];
+};
+
+/*
+The script each worker runs.  Passed with -c, so it must not contain double quotes or backslashes.
+argv: shared memory name, shared memory size, worker index, doorbell, module, sys.path entries...
+*/
+static const char *WORKER_SCRIPT = R"(import importlib, mmap, os, struct, sys, threading
+name, size, index, doorbell, module = sys.argv[1], int(sys.argv[2]), int(sys.argv[3]), int(sys.argv[4]), sys.argv[5]
+sys.path[:0] = sys.argv[6:]
+if os.name == 'nt':
+    import msvcrt
+    shm = mmap.mmap(-1, size, tagname=name)
+    doorbell = msvcrt.open_osfhandle(doorbell, os.O_RDONLY)
+else:
+    fd = os.open('/dev/shm/' + name, os.O_RDWR)
+    shm = mmap.mmap(fd, size)
+    os.close(fd)
+module = __import__(module, fromlist=['*'])
+magic, workers, slots, slot_size, ring_offset, slot_offset = struct.unpack_from('<6I', shm, 0)
+ring = ring_offset + index * 4 * (slots + 2)
+capacity = slot_size - 16
+read_pos = 0
+functions = {}
+fence = threading.Lock()
+while True:
+    if read_pos == struct.unpack_from('<I', shm, ring)[0]:
+        struct.pack_into('<I', shm, ring + 4, read_pos)
+        with fence:
+            pass
+        if read_pos == struct.unpack_from('<I', shm, ring)[0] and not os.read(doorbell, 64):
+            break
+        continue
+    slot = slot_offset + slot_size * struct.unpack_from('<I', shm, ring + 8 + 4 * (read_pos % slots))[0]
+    read_pos = (read_pos + 1) & 0xFFFFFFFF
+    function_length, argument_length = struct.unpack_from('<II', shm, slot + 4)
+    data = slot + 16
+    function = shm[data:data + function_length].decode()
+    argument = shm[data + function_length:data + function_length + argument_length]
+    struct.pack_into('<I', shm, slot, 2)
+    try:
+        target = functions.get(function)
+        if target is None:
+            module_name, _, name = function.rpartition(':')
+            target = functions[function] = getattr(importlib.import_module(module_name) if module_name else module, name)
+        result = target(argument)
+        result = b'' if result is None else result.encode() if isinstance(result, str) else bytes(result)
+        state = 3
+    except Exception as e:
+        result = ('%s: %s' % (type(e).__name__, e)).encode()
+        state = 4
+    if len(result) > capacity:
+        result = ('%s returned %d bytes, but slots hold %d.' % (function, len(result), capacity)).encode()
+        state = 4
+    shm[data:data + len(result)] = result
+    struct.pack_into('<I', shm, slot + 12, len(result))
+    struct.pack_into('<I', shm, slot, state)
+)";
+
+struct WorkerProcess
+{
+#ifdef _WIN32
+	HANDLE process;
+	HANDLE doorbell;
+#else
+	pid_t pid;
+	int doorbell;
+#endif
+	bool exited;
+	uint32_t tail;
+	std::vector<int> freeSlots;
+};
+
+struct WorkerPool
+{
+	std::string name;
+	size_t size;
+	char *memory;
+#ifdef _WIN32
+	HANDLE mapping;
+#endif
+	PoolHeader *header;
+	std::vector<WorkerProcess> workers;
+	std::map<int, int> jobs; // job id -> slot index
+	std::vector<int> orphans; // ids of jobs abandoned by a failed PyPool_Map, released once they finish
+	int nextJobID;
+};
+
+WorkerPool *m_Pool = NULL;
+
+static std::atomic<uint32_t> *GetRing(int worker)
+{
+	return reinterpret_cast<std::atomic<uint32_t> *>(m_Pool->memory + m_Pool->header->ringOffset + worker * 4 * (POOL_SLOTS_PER_WORKER + POOL_RING_HEADER));
+}
+
+static PoolSlot *GetSlot(int slot)
+{
+	return reinterpret_cast<PoolSlot *>(m_Pool->memory + m_Pool->header->slotOffset + (size_t)slot * m_Pool->header->slotSize);
+}
+
+static void PoolError(const char *caller, const char *message)
+{
+	std::string msg = caller;
+	msg += ": ";
+	msg += message;
+	agk::PluginError(msg.c_str());
+}
+
+/*
+Platform specific parts.
+*/
+#ifdef _WIN32
+// Quotes an argument so that the C runtime's command line parser reads it back unchanged.
+static std::string QuoteArgument(const std::string &arg)
+{
+	std::string quoted = "\"";
+	int backslashes = 0;
+	for (char ch : arg)
+	{
+		if (ch == '\\')
+		{
+			backslashes++;
+			continue;
+		}
+		quoted.append((ch == '"') ? backslashes * 2 + 1 : backslashes, '\\');
+		backslashes = 0;
+		quoted += ch;
+	}
+	quoted.append(backslashes * 2, '\\');
+	quoted += "\"";
+	return quoted;
+}
+
+static bool CreateSharedMemory(WorkerPool *pool)
+{
+	pool->name = "agk_python_pool_" + std::to_string(GetCurrentProcessId());
+	pool->mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, (DWORD)pool->size, pool->name.c_str());
+	if (pool->mapping == NULL)
+	{
+		return false;
+	}
+	pool->memory = (char *)MapViewOfFile(pool->mapping, FILE_MAP_ALL_ACCESS, 0, 0, pool->size);
+	return pool->memory != NULL;
+}
+
+static void FreeSharedMemory(WorkerPool *pool)
+{
+	if (pool->memory)
+	{
+		UnmapViewOfFile(pool->memory);
+	}
+	if (pool->mapping)
+	{
+		CloseHandle(pool->mapping);
+	}
+}
+
+static bool StartWorker(WorkerProcess &worker, std::vector<std::string> args)
+{
+	SECURITY_ATTRIBUTES sa = { sizeof(sa), NULL, TRUE };
+	HANDLE readEnd;
+	if (!CreatePipe(&readEnd, &worker.doorbell, &sa, 0))
+	{
+		return false;
+	}
+	// Only the read end goes to the worker.
+	SetHandleInformation(worker.doorbell, HANDLE_FLAG_INHERIT, 0);
+	args[POOL_DOORBELL_ARG] = std::to_string((uintptr_t)readEnd);
+	std::string commandLine;
+	for (const std::string &arg : args)
+	{
+		commandLine += QuoteArgument(arg) + " ";
+	}
+	STARTUPINFOA si = { sizeof(si) };
+	PROCESS_INFORMATION pi;
+	BOOL started = CreateProcessA(NULL, &commandLine[0], NULL, NULL, TRUE, CREATE_NO_WINDOW, NULL, NULL, &si, &pi);
+	CloseHandle(readEnd);
+	if (!started)
+	{
+		CloseHandle(worker.doorbell);
+		worker.doorbell = NULL;
+		return false;
+	}
+	CloseHandle(pi.hThread);
+	worker.process = pi.hProcess;
+	return true;
+}
+
+static void RingDoorbell(WorkerProcess &worker)
+{
+	DWORD written;
+	WriteFile(worker.doorbell, "!", 1, &written, NULL);
+}
+
+static bool HasExited(WorkerProcess &worker)
+{
+	if (!worker.exited && WaitForSingleObject(worker.process, 0) == WAIT_OBJECT_0)
+	{
+		worker.exited = true;
+	}
+	return worker.exited;
+}
+
+// Closing the doorbell tells the worker to exit once its ring is empty.
+static void CloseDoorbell(WorkerProcess &worker)
+{
+	if (worker.doorbell)
+	{
+		CloseHandle(worker.doorbell);
+		worker.doorbell = NULL;
+	}
+}
+
+static void StopWorker(WorkerProcess &worker, int timeoutMS)
+{
+	if (worker.process)
+	{
+		if (WaitForSingleObject(worker.process, (DWORD)timeoutMS) != WAIT_OBJECT_0)
+		{
+			TerminateProcess(worker.process, 1);
+		}
+		CloseHandle(worker.process);
+	}
+}
+#else
+static bool CreateSharedMemory(WorkerPool *pool)
+{
+	pool->name = "agk_python_pool_" + std::to_string(getpid());
+	std::string path = "/" + pool->name;
+	int fd = shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd == -1)
+	{
+		return false;
+	}
+	void *memory = MAP_FAILED;
+	if (ftruncate(fd, (off_t)pool->size) == 0)
+	{
+		memory = mmap(NULL, pool->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	pool->memory = (memory == MAP_FAILED) ? NULL : (char *)memory;
+	return pool->memory != NULL;
+}
+
+static void FreeSharedMemory(WorkerPool *pool)
+{
+	if (pool->memory)
+	{
+		munmap(pool->memory, pool->size);
+	}
+	shm_unlink(("/" + pool->name).c_str());
+}
+
+static bool StartWorker(WorkerProcess &worker, std::vector<std::string> args)
+{
+	int ends[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, ends) == -1)
+	{
+		return false;
+	}
+	// Keep both ends out of other workers.  The child clears the flag on its own end before exec.
+	fcntl(ends[0], F_SETFD, FD_CLOEXEC);
+	fcntl(ends[1], F_SETFD, FD_CLOEXEC);
+	args[POOL_DOORBELL_ARG] = std::to_string(ends[1]);
+	// Only async-signal-safe calls are allowed between fork and exec, so build argv first.
+	std::vector<char *> argv;
+	for (std::string &arg : args)
+	{
+		argv.push_back(&arg[0]);
+	}
+	argv.push_back(NULL);
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		fcntl(ends[1], F_SETFD, 0);
+		execvp(argv[0], argv.data());
+		_exit(127);
+	}
+	close(ends[1]);
+	if (pid == -1)
+	{
+		close(ends[0]);
+		return false;
+	}
+	worker.pid = pid;
+	worker.doorbell = ends[0];
+	return true;
+}
+
+static void RingDoorbell(WorkerProcess &worker)
+{
+#ifdef MSG_NOSIGNAL
+	send(worker.doorbell, "!", 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+	send(worker.doorbell, "!", 1, MSG_DONTWAIT);
+#endif
+}
+
+static bool HasExited(WorkerProcess &worker)
+{
+	if (!worker.exited && waitpid(worker.pid, NULL, WNOHANG) == worker.pid)
+	{
+		worker.exited = true;
+	}
+	return worker.exited;
+}
+
+// Closing the doorbell tells the worker to exit once its ring is empty.
+static void CloseDoorbell(WorkerProcess &worker)
+{
+	if (worker.doorbell)
+	{
+		close(worker.doorbell);
+		worker.doorbell = 0;
+	}
+}
+
+static void StopWorker(WorkerProcess &worker, int timeoutMS)
+{
+	if (worker.pid)
+	{
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMS);
+		while (!HasExited(worker) && std::chrono::steady_clock::now() < deadline)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		if (!worker.exited)
+		{
+			kill(worker.pid, SIGKILL);
+			waitpid(worker.pid, NULL, 0);
+		}
+	}
+}
+#endif
+
+static void DestroyPool(WorkerPool *pool)
+{
+	// Close every doorbell first so that the workers all shut down at the same time.
+	for (WorkerProcess &worker : pool->workers)
+	{
+		CloseDoorbell(worker);
+	}
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(POOL_STOP_TIMEOUT_MS);
+	for (WorkerProcess &worker : pool->workers)
+	{
+		auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+		StopWorker(worker, std::max(0, (int)remaining.count()));
+	}
+	FreeSharedMemory(pool);
+	delete pool;
+}
+
+/*
+Returns sys.path with each entry made absolute so the workers can find the same modules.
+*/
+static bool GetWorkerPaths(std::vector<std::string> &paths)
+{
+	PyObject *ospath = PyImport_ImportModule("os.path");
+	if (ospath == NULL)
+	{
+		return false;
+	}
+	PyObject *syspath = PySys_GetObject("path"); // borrowed
+	for (Py_ssize_t index = 0; syspath && index < PyList_Size(syspath); index++)
+	{
+		PyObject *path = PyObject_CallMethod(ospath, "abspath", "O", PyList_GET_ITEM(syspath, index));
+		if (path == NULL)
+		{
+			Py_DECREF(ospath);
+			return false;
+		}
+		if (const char *text = PyUnicode_AsUTF8(path))
+		{
+			paths.push_back(text);
+		}
+		Py_DECREF(path);
+	}
+	Py_DECREF(ospath);
+	return !PyErr_Occurred();
+}
+
+/*
+Starts the pool.  python is the python executable the workers run and module is the module they import.
+workers = 0 uses one worker per CPU core.  slotSize is the largest argument or result a job can have, plus 16 bytes.
+Returns the number of workers started, or 0 on failure.
+*/
+int PyPool_Start(const char *python, const char *module, int workers, int slotSize)
+{
+	HOLD_GIL
+	if (m_Pool)
+	{
+		PoolError(__FUNCTION__, "The pool is already running.");
+		return 0;
+	}
+	if (workers <= 0)
+	{
+		workers = std::max(1, (int)std::thread::hardware_concurrency());
+	}
+	if (slotSize < POOL_MIN_SLOT_SIZE)
+	{
+		slotSize = POOL_MIN_SLOT_SIZE;
+	}
+	// Keep slots 4-byte aligned.
+	slotSize = (slotSize + 3) & ~3;
+	std::vector<std::string> paths;
+	if (!GetWorkerPaths(paths))
+	{
+		CheckError();
+		return 0;
+	}
+	WorkerPool *pool = new WorkerPool();
+	pool->nextJobID = 1;
+	uint32_t ringOffset = sizeof(PoolHeader);
+	uint32_t slotOffset = ringOffset + workers * 4 * (POOL_SLOTS_PER_WORKER + POOL_RING_HEADER);
+	pool->size = slotOffset + (size_t)workers * POOL_SLOTS_PER_WORKER * slotSize;
+	if (!CreateSharedMemory(pool))
+	{
+		FreeSharedMemory(pool);
+		delete pool;
+		PoolError(__FUNCTION__, "Could not create the shared memory.");
+		return 0;
+	}
+	memset(pool->memory, 0, pool->size);
+	pool->header = reinterpret_cast<PoolHeader *>(pool->memory);
+	pool->header->workerCount = workers;
+	pool->header->slotsPerWorker = POOL_SLOTS_PER_WORKER;
+	pool->header->slotSize = slotSize;
+	pool->header->ringOffset = ringOffset;
+	pool->header->slotOffset = slotOffset;
+	pool->header->magic = POOL_MAGIC;
+	// See WORKER_SCRIPT for the arguments.
+	std::vector<std::string> args = { python, "-c", WORKER_SCRIPT, pool->name, std::to_string(pool->size), "", "", module };
+	args.insert(args.end(), paths.begin(), paths.end());
+	pool->workers.resize(workers);
+	for (int index = 0; index < workers; index++)
+	{
+		WorkerProcess &worker = pool->workers[index];
+		for (int slot = POOL_SLOTS_PER_WORKER - 1; slot >= 0; slot--)
+		{
+			worker.freeSlots.push_back(index * POOL_SLOTS_PER_WORKER + slot);
+		}
+		args[5] = std::to_string(index);
+		if (!StartWorker(worker, args))
+		{
+			DestroyPool(pool);
+			PoolError(__FUNCTION__, "Could not start a worker process.");
+			return 0;
+		}
+	}
+	m_Pool = pool;
+	return workers;
+}
+
+/*
+Stops the worker processes.  Any jobs still running are lost.
+*/
+void PyPool_Stop()
+{
+	if (m_Pool)
+	{
+		DestroyPool(m_Pool);
+		m_Pool = NULL;
+	}
+}
+
+int PyPool_GetWorkerCount()
+{
+	return (m_Pool) ? (int)m_Pool->workers.size() : 0;
+}
+
+static void ReleaseFinishedOrphans();
+
+static int SubmitJob(const char *function, const char *argument, int argumentLength, const char *caller)
+{
+	if (m_Pool == NULL)
+	{
+		PoolError(caller, "The pool is not running.");
+		return 0;
+	}
+	ReleaseFinishedOrphans();
+	uint32_t functionLength = (uint32_t)strlen(function);
+	if (functionLength + argumentLength > m_Pool->header->slotSize - POOL_SLOT_HEADER_SIZE)
+	{
+		PoolError(caller, "The argument does not fit in a slot.");
+		return 0;
+	}
+	// Give the job to the least busy worker.
+	int workerIndex = -1;
+	for (int index = 0; index < (int)m_Pool->workers.size(); index++)
+	{
+		WorkerProcess &worker = m_Pool->workers[index];
+		if (!worker.freeSlots.empty() && !HasExited(worker)
+			&& (workerIndex == -1 || worker.freeSlots.size() > m_Pool->workers[workerIndex].freeSlots.size()))
+		{
+			workerIndex = index;
+		}
+	}
+	if (workerIndex == -1)
+	{
+		PoolError(caller, "All slots are in use.  Release finished jobs with PyPool_Release.");
+		return 0;
+	}
+	WorkerProcess &worker = m_Pool->workers[workerIndex];
+	int slotIndex = worker.freeSlots.back();
+	worker.freeSlots.pop_back();
+	PoolSlot *slot = GetSlot(slotIndex);
+	slot->functionLength = functionLength;
+	slot->argumentLength = argumentLength;
+	slot->resultLength = 0;
+	memcpy(slot->data, function, functionLength);
+	memcpy(slot->data + functionLength, argument, argumentLength);
+	slot->state.store(SLOT_QUEUED, std::memory_order_release);
+	std::atomic<uint32_t> *ring = GetRing(workerIndex);
+	uint32_t tail = worker.tail;
+	ring[POOL_RING_HEADER + tail % POOL_SLOTS_PER_WORKER].store(slotIndex, std::memory_order_relaxed);
+	// Sequentially consistent so that the tail is visible before the head is read.  Pairs with the fence in the
+	// worker between storing the head and reading the tail.
+	ring[0].store(++worker.tail, std::memory_order_seq_cst);
+	if (ring[1].load(std::memory_order_seq_cst) == tail)
+	{
+		RingDoorbell(worker);
+	}
+	int job = m_Pool->nextJobID++;
+	m_Pool->jobs[job] = slotIndex;
+	return job;
+}
+
+/*
+Queues a call to function(argument) in the worker module.  Returns a job id, or 0 on failure.
+*/
+int PyPool_Submit(const char *function, const char *argument)
+{
+	return SubmitJob(function, argument, (int)strlen(argument), __FUNCTION__);
+}
+
+/*
+Same as PyPool_Submit, but the argument is size bytes from a memblock.
+*/
+int PyPool_SubmitMemblock(const char *function, int memID, int offset, int size)
+{
+	unsigned char *data = GetMemblockRange(memID, offset, size);
+	if (data == NULL)
+	{
+		return 0;
+	}
+	return SubmitJob(function, (const char *)data, size, __FUNCTION__);
+}
+
+static PoolSlot *GetJobSlot(int job, const char *caller)
+{
+	if (m_Pool == NULL)
+	{
+		PoolError(caller, "The pool is not running.");
+		return NULL;
+	}
+	auto found = m_Pool->jobs.find(job);
+	if (found == m_Pool->jobs.end())
+	{
+		PoolError(caller, "Invalid job id.");
+		return NULL;
+	}
+	return GetSlot(found->second);
+}
+
+// Returns the slot of a job that has finished.  Reports the job's error if it failed.
+static PoolSlot *GetFinishedJobSlot(int job, const char *caller)
+{
+	PoolSlot *slot = GetJobSlot(job, caller);
+	if (slot == NULL)
+	{
+		return NULL;
+	}
+	uint32_t state = slot->state.load(std::memory_order_acquire);
+	if (state == SLOT_FAILED)
+	{
+		std::string error(slot->data, slot->resultLength);
+		PoolError(caller, error.c_str());
+		return NULL;
+	}
+	if (state != SLOT_DONE)
+	{
+		PoolError(caller, "The job has not finished.");
+		return NULL;
+	}
+	return slot;
+}
+
+/*
+Returns one of: -1 = failed, 0 = unknown job, 1 = pending, 2 = running, 3 = done.
+A job whose worker process has exited is marked as failed.
+*/
+int PyPool_GetState(int job)
+{
+	if (m_Pool == NULL)
+	{
+		return 0;
+	}
+	auto found = m_Pool->jobs.find(job);
+	if (found == m_Pool->jobs.end())
+	{
+		return 0;
+	}
+	PoolSlot *slot = GetSlot(found->second);
+	uint32_t state = slot->state.load(std::memory_order_acquire);
+	if ((state == SLOT_QUEUED || state == SLOT_RUNNING) && HasExited(m_Pool->workers[found->second / POOL_SLOTS_PER_WORKER]))
+	{
+		static const char message[] = "The worker process exited.";
+		memcpy(slot->data, message, sizeof(message) - 1);
+		slot->resultLength = sizeof(message) - 1;
+		slot->state.store(SLOT_FAILED, std::memory_order_release);
+		state = SLOT_FAILED;
+	}
+	return (state == SLOT_FAILED) ? -1 : (int)state;
+}
+
+/*
+Returns the size of a finished job's result in bytes.
+*/
+int PyPool_GetResultSize(int job)
+{
+	PoolSlot *slot = GetFinishedJobSlot(job, __FUNCTION__);
+	return (slot) ? (int)slot->resultLength : 0;
+}
+
+char *PyPool_GetResultString(int job)
+{
+	PoolSlot *slot = GetFinishedJobSlot(job, __FUNCTION__);
+	if (slot == NULL)
+	{
+		return CreateString("");
+	}
+	std::string result(slot->data, slot->resultLength);
+	return CreateString(result.c_str());
+}
+
+/*
+Copies a finished job's result into a memblock at the given offset.  Returns the number of bytes copied.
+*/
+int PyPool_CopyResult(int job, int memID, int offset)
+{
+	PoolSlot *slot = GetFinishedJobSlot(job, __FUNCTION__);
+	if (slot == NULL)
+	{
+		return 0;
+	}
+	unsigned char *dest = GetMemblockRange(memID, offset, (int)slot->resultLength);
+	if (dest == NULL)
+	{
+		return 0;
+	}
+	memcpy(dest, slot->data, slot->resultLength);
+	return (int)slot->resultLength;
+}
+
+/*
+Frees a finished job's slot and id.
+*/
+void PyPool_Release(int job)
+{
+	PoolSlot *slot = GetJobSlot(job, __FUNCTION__);
+	if (slot == NULL)
+	{
+		return;
+	}
+	int slotIndex = m_Pool->jobs[job];
+	uint32_t state = slot->state.load(std::memory_order_acquire);
+	if (state == SLOT_QUEUED || state == SLOT_RUNNING)
+	{
+		PoolError(__FUNCTION__, "The job has not finished.");
+		return;
+	}
+	slot->state.store(SLOT_FREE, std::memory_order_relaxed);
+	m_Pool->workers[slotIndex / POOL_SLOTS_PER_WORKER].freeSlots.push_back(slotIndex);
+	m_Pool->jobs.erase(job);
+}
+
+static void ReleaseFinishedOrphans()
+{
+	for (auto it = m_Pool->orphans.begin(); it != m_Pool->orphans.end();)
+	{
+		int state = PyPool_GetState(*it);
+		if (state == SLOT_QUEUED || state == SLOT_RUNNING)
+		{
+			++it;
+			continue;
+		}
+		PyPool_Release(*it);
+		it = m_Pool->orphans.erase(it);
+	}
+}
+
+// Whether SubmitJob can find a free slot on a running worker.
+static bool HasFreeSlot()
+{
+	ReleaseFinishedOrphans();
+	for (WorkerProcess &worker : m_Pool->workers)
+	{
+		if (!worker.freeSlots.empty() && !HasExited(worker))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+Parallel map.
+*/
+double m_MapTime = 0;
+std::vector<int> m_MapWorkerRecords;
+
+/*
+Runs function on every record of inMemID, spread across the pool's workers, and writes the results to outMemID.
+The input memblock holds records of recordSize bytes.  Each call gets a chunk of whole records as one bytes argument
+and must return outRecordSize bytes per record.
+outMemID can be inMemID to write the results in place, as long as outRecordSize is not larger than recordSize.
+Waits for all chunks to finish, but fails if no chunk finishes for POOL_MAP_TIMEOUT_MS.  Chunks still running after a
+failure keep their slots until they finish.  Returns the number of records processed, or -1 on failure.
+*/
+int PyPool_Map(const char *function, int inMemID, int recordSize, int outMemID, int outRecordSize)
+{
+	if (m_Pool == NULL)
+	{
+		PoolError(__FUNCTION__, "The pool is not running.");
+		return -1;
+	}
+	if (recordSize <= 0 || outRecordSize <= 0)
+	{
+		PoolError(__FUNCTION__, "Record sizes must be greater than 0.");
+		return -1;
+	}
+	unsigned char *input = GetMemblockRange(inMemID, 0, 0);
+	if (input == NULL)
+	{
+		return -1;
+	}
+	int recordCount = agk::GetMemblockSize(inMemID) / recordSize;
+	if (recordCount > INT_MAX / outRecordSize)
+	{
+		PoolError(__FUNCTION__, "The output is too large for a memblock.");
+		return -1;
+	}
+	unsigned char *output = GetMemblockRange(outMemID, 0, recordCount * outRecordSize);
+	if (output == NULL)
+	{
+		return -1;
+	}
+	// Aim for a few chunks per worker so that the workers finish at about the same time.
+	int workerCount = (int)m_Pool->workers.size();
+	int capacity = (int)(m_Pool->header->slotSize - POOL_SLOT_HEADER_SIZE);
+	int chunkSize = std::max(1, recordCount / (workerCount * 4));
+	chunkSize = std::min(chunkSize, (capacity - (int)strlen(function)) / recordSize);
+	chunkSize = std::min(chunkSize, capacity / outRecordSize);
+	if (chunkSize < 1)
+	{
+		PoolError(__FUNCTION__, "A record does not fit in a slot.");
+		return -1;
+	}
+	auto start = std::chrono::steady_clock::now();
+	m_MapWorkerRecords.assign(workerCount, 0);
+	std::map<int, int> running; // job id -> first record
+	int nextRecord = 0;
+	int finished = 0;
+	bool failed = false;
+	auto lastProgress = start;
+	while (finished < recordCount && !failed)
+	{
+		// Keep every free slot busy.  Some slots may be held by other jobs or belong to workers that have exited.
+		while (nextRecord < recordCount && HasFreeSlot())
+		{
+			int count = std::min(chunkSize, recordCount - nextRecord);
+			int job = SubmitJob(function, (const char *)input + (size_t)nextRecord * recordSize, count * recordSize, __FUNCTION__);
+			if (job == 0)
+			{
+				failed = true;
+				break;
+			}
+			running[job] = nextRecord;
+			nextRecord += count;
+		}
+		if (running.empty() && !failed)
+		{
+			PoolError(__FUNCTION__, "No worker has a free slot.");
+			failed = true;
+		}
+		bool progress = false;
+		for (auto it = running.begin(); it != running.end() && !failed;)
+		{
+			int state = PyPool_GetState(it->first);
+			if (state == SLOT_QUEUED || state == SLOT_RUNNING)
+			{
+				++it;
+				continue;
+			}
+			int job = it->first;
+			int first = it->second;
+			int count = std::min(chunkSize, recordCount - first);
+			int slotIndex = m_Pool->jobs[job];
+			PoolSlot *slot = GetSlot(slotIndex);
+			if (state == SLOT_DONE && slot->resultLength == (uint32_t)(count * outRecordSize))
+			{
+				memcpy(output + (size_t)first * outRecordSize, slot->data, slot->resultLength);
+				m_MapWorkerRecords[slotIndex / POOL_SLOTS_PER_WORKER] += count;
+				finished += count;
+			}
+			else
+			{
+				std::string error = (state == SLOT_DONE) ? "The function returned the wrong number of bytes." : std::string(slot->data, slot->resultLength);
+				PoolError(__FUNCTION__, error.c_str());
+				failed = true;
+			}
+			PyPool_Release(job);
+			it = running.erase(it);
+			progress = true;
+		}
+		auto now = std::chrono::steady_clock::now();
+		if (progress)
+		{
+			lastProgress = now;
+		}
+		else if (!failed && now - lastProgress > std::chrono::milliseconds(POOL_MAP_TIMEOUT_MS))
+		{
+			PoolError(__FUNCTION__, "Timed out waiting for the workers.");
+			failed = true;
+		}
+		else
+		{
+			// Sleep rather than spin.  There is one worker per core, so spinning would take a core from them.
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+	// Don't wait for the chunks of a failed map.  They release their slots once they finish.
+	for (auto &entry : running)
+	{
+		m_Pool->orphans.push_back(entry.first);
+	}
+	m_MapTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return (failed) ? -1 : finished;
+}
+
+/*
+Returns the wall time of the last PyPool_Map call in milliseconds.
+*/
+float PyPool_GetMapTime()
+{
+	return (float)(m_MapTime * 1000.0);
+}
+
+/*
+Returns the number of records the given worker (0-based) processed in the last PyPool_Map call.
+*/
+int PyPool_GetMapWorkerRecords(int worker)
+{
+	return (worker >= 0 && worker < (int)m_MapWorkerRecords.size()) ? m_MapWorkerRecords[worker] : 0;
+}
+
+/*
+Returns the given worker's records per second in the last PyPool_Map call.
+*/
+float PyPool_GetMapWorkerThroughput(int worker)
+{
+	return (m_MapTime > 0) ? (float)(PyPool_GetMapWorkerRecords(worker) / m_MapTime) : 0.0f;
+}
@@ -0,0 +1,246 @@
+"""
+Generates the plugin's binding files from its headers.
+
+    python generate_bindings.py
+
+Windows/AgkBindings.inc
+    The agk module's thunks and method table, one thunk per AGK command in AGKLibraryCommands.h.  Overloads are
+    picked by argument count and then by argument type.  Included by Windows/AgkModule.cpp.
+
+../AGKPlugin/PythonPlugin/Commands.txt
+    One row per function exported in Windows/PythonPlugin.h.  The AGK command name is the export name without its
+    leading underscore unless the declaration ends with a "// AGK: Name" comment.  Commented-out declarations become
+    commented-out rows and "//" comments after a blank line start a new section.
+
+Run it after changing either header and commit the results.
+"""
+import argparse
+import os
+import re
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+AGK_HEADER = os.path.join(HERE, "AGKLibraryCommands.h")
+PLUGIN_HEADER = os.path.join(HERE, "Windows", "PythonPlugin.h")
+BINDINGS_OUTPUT = os.path.join(HERE, "Windows", "AgkBindings.inc")
+COMMANDS_OUTPUT = os.path.join(HERE, "..", "AGKPlugin", "PythonPlugin", "Commands.txt")
+
+# Commands.txt platform columns, in order.
+PLATFORMS = ["Windows", "Linux", "Mac", "Android", "iOS", "Windows64"]
+# Platforms the plugin is built for.  The others get 0.
+BUILT_PLATFORMS = ["Windows"]
+
+# Memory management commands that make no sense from Python.
+SKIPPED_COMMANDS = {"CreateString", "DeleteString"}
+
+# C type: (converter, Python type check used to pick between overloads, doc type)
+ARGUMENT_TYPES = {
+    "int": ("ToInt", "PyLong_Check({0})", "int"),
+    "unsigned int": ("ToUInt", "PyLong_Check({0})", "int"),
+    "float": ("ToFloat", "PyFloat_Check({0}) || PyLong_Check({0})", "float"),
+    "const char*": ("ToString", "PyUnicode_Check({0})", "str"),
+}
+# C type: (return statement, doc type)
+RETURN_TYPES = {
+    "void": ("Py_RETURN_NONE;", None),
+    "int": ("return PyLong_FromLong({0});", "int"),
+    "unsigned int": ("return PyLong_FromUnsignedLong({0});", "int"),
+    "float": ("return PyFloat_FromDouble({0});", "float"),
+    "char*": ("return FromString({0});", "str"),
+}
+# Parameter names that would clash with the thunk's own names or C++ keywords.
+RESERVED_NAMES = {"self", "args", "nargs", "kwnames", "default", "new", "delete", "class", "template", "this",
+                  "operator", "register", "union", "int", "float", "char"}
+
+# Commands.txt type codes.
+COMMAND_TYPES = {
+    "void": "0",
+    "int": "I",
+    "float": "F",
+    "char*": "S",
+    "const char*": "S",
+}
+
+AGK_COMMAND = re.compile(r"^\s*static inline (.+?)\s*\b(\w+)\(\s*(.*?)\s*\)\s*\{", re.M)
+PLUGIN_EXPORT = re.compile(r'^(//\s*)?extern "C" DLL_EXPORT\s+(.+?)\s*\b(\w+)\s*\((.*?)\);\s*(?://\s*(.*))?$')
+
+
+def normalize_type(text):
+    text = re.sub(r"\s*\*", "*", text.strip())
+    return re.sub(r"\s+", " ", text)
+
+
+def split_parameter(text):
+    match = re.match(r"(.*?)\s*\b(\w+)$", text.strip())
+    return normalize_type(match.group(1)), match.group(2)
+
+
+class AgkCommand:
+    def __init__(self, return_type, name, parameters):
+        self.return_type = return_type
+        self.name = name
+        self.parameters = parameters
+
+    def is_supported(self):
+        return self.return_type in RETURN_TYPES and all(ptype in ARGUMENT_TYPES for ptype, _ in self.parameters)
+
+    def doc(self):
+        text = "{}({})".format(self.name, ", ".join(pname for _, pname in self.parameters))
+        doc_type = RETURN_TYPES[self.return_type][1]
+        return text + " -> " + doc_type if doc_type else text
+
+    def strictness(self):
+        # Overloads taking ints must be tried before ones taking floats, which also accept ints.
+        return sum(1 for ptype, _ in self.parameters if ptype == "float")
+
+
+def read_agk_commands():
+    with open(AGK_HEADER) as f:
+        source = f.read()
+    commands = {}
+    for return_type, name, parameters in AGK_COMMAND.findall(source):
+        if name in SKIPPED_COMMANDS:
+            continue
+        parameters = [split_parameter(p) for p in parameters.split(",") if p.strip()]
+        parameters = [(ptype, pname + "_" if pname in RESERVED_NAMES else pname) for ptype, pname in parameters]
+        command = AgkCommand(normalize_type(return_type), name, parameters)
+        if command.is_supported():
+            commands.setdefault(name, []).append(command)
+    return commands
+
+
+def write_call(lines, command, indent):
+    """Writes the argument conversion and the call for one overload."""
+    for ptype, pname in command.parameters:
+        declaration = ptype[:-1] + " *" + pname if ptype.endswith("*") else ptype + " " + pname
+        lines.append(indent + declaration + ";")
+    if command.parameters:
+        checks = ["!{}(args[{}], {})".format(ARGUMENT_TYPES[ptype][0], index, pname)
+                  for index, (ptype, pname) in enumerate(command.parameters)]
+        lines.append(indent + "if (" + " || ".join(checks) + ")")
+        lines.append(indent + "{")
+        lines.append(indent + "\treturn NULL;")
+        lines.append(indent + "}")
+    call = "agk::{}({})".format(command.name, ", ".join(pname for _, pname in command.parameters))
+    if command.return_type == "void":
+        lines.append(indent + call + ";")
+    lines.append(indent + RETURN_TYPES[command.return_type][0].format(call))
+
+
+def write_overloads(lines, name, overloads, indent):
+    """Writes the overloads that take the same number of arguments."""
+    if len(overloads) == 1:
+        write_call(lines, overloads[0], indent)
+        return
+    for command in sorted(overloads, key=AgkCommand.strictness):
+        checks = [ARGUMENT_TYPES[ptype][1].format("args[{}]".format(index))
+                  for index, (ptype, _) in enumerate(command.parameters)]
+        if len(checks) > 1:
+            checks = ["(" + check + ")" if " || " in check else check for check in checks]
+        lines.append(indent + "if (" + " && ".join(checks) + ")")
+        lines.append(indent + "{")
+        write_call(lines, command, indent + "\t")
+        lines.append(indent + "}")
+    lines.append(indent + 'PyErr_SetString(PyExc_TypeError, "agk.{}: The argument types do not match any overload.");'
+                 .format(name))
+    lines.append(indent + "return NULL;")
+
+
+def write_thunk(lines, name, overloads):
+    by_count = {}
+    for command in overloads:
+        by_count.setdefault(len(command.parameters), []).append(command)
+    counts = sorted(by_count)
+    lines.append("AGK_THUNK({})".format(name))
+    lines.append("{")
+    lines.append("\tAGK_BEGIN({}, {}, {})".format(name, counts[0], counts[-1]))
+    if len(counts) == 1:
+        write_overloads(lines, name, by_count[counts[0]], "\t")
+    else:
+        lines.append("\tswitch (nargs)")
+        lines.append("\t{")
+        for count in counts:
+            lines.append("\tcase {}:".format(count))
+            lines.append("\t{")
+            write_overloads(lines, name, by_count[count], "\t\t")
+            lines.append("\t}")
+        lines.append("\t}")
+        lines.append('\tPyErr_Format(PyExc_TypeError, "agk.{} does not take %zd arguments.", nargs);'.format(name))
+        lines.append("\treturn NULL;")
+    lines.append("}")
+    lines.append("")
+
+
+def c_string(text):
+    return '"' + text.replace("\\", "\\\\").replace('"', '\\"').replace("\n", "\\n") + '"'
+
+
+def generate_bindings():
+    commands = read_agk_commands()
+    lines = [
+        "// Generated by generate_bindings.py from AGKLibraryCommands.h.  Do not edit.",
+        "",
+    ]
+    for name, overloads in commands.items():
+        write_thunk(lines, name, overloads)
+    lines.append("static PyMethodDef AgkMethods[] = {")
+    for name, overloads in commands.items():
+        doc = "\n".join(command.doc() for command in overloads)
+        lines.append("\tAGK_METHOD({}, {}),".format(name, c_string(doc)))
+    lines.append("\t{ NULL, NULL, 0, NULL }")
+    lines.append("};")
+    with open(BINDINGS_OUTPUT, "w", newline="\n") as f:
+        f.write("\n".join(lines) + "\n")
+    return sum(len(overloads) for overloads in commands.values()), len(commands)
+
+
+def command_type(text):
+    text = normalize_type(text)
+    if text not in COMMAND_TYPES:
+        raise ValueError("Unsupported type for Commands.txt: " + text)
+    return COMMAND_TYPES[text]
+
+
+def section_title(comment):
+    # "// Worker process pool, see WorkerPool.cpp" -> "Worker process pool"
+    return re.sub(r",\s*see \S+$", "", comment.strip())
+
+
+def generate_commands(platforms):
+    rows = ["#CommandName,ReturnType,ParameterTypes," + ",".join(PLATFORMS)]
+    previous_blank = False
+    with open(PLUGIN_HEADER) as f:
+        for line in f:
+            line = line.strip()
+            match = PLUGIN_EXPORT.match(line)
+            if match:
+                commented, return_type, export, parameters, comment = match.groups()
+                name = export.lstrip("_")
+                if comment and comment.startswith("AGK:"):
+                    name = comment[4:].strip()
+                parameters = [p for p in parameters.split(",") if p.strip() and p.strip() != "..."]
+                parameter_types = "".join(command_type(split_parameter(p)[0]) for p in parameters) or "0"
+                columns = [export if platform in platforms else "0" for platform in PLATFORMS]
+                row = ",".join([name, command_type(return_type), parameter_types] + columns)
+                rows.append("# " + row if commented else row)
+            elif line.startswith("//") and previous_blank:
+                rows.extend(["#", "# " + section_title(line[2:]), "#"])
+            previous_blank = not line
+    with open(COMMANDS_OUTPUT, "w", newline="\n") as f:
+        f.write("\n".join(rows) + "\n")
+    return len([row for row in rows if not row.startswith("#")])
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generates AgkBindings.inc and Commands.txt.")
+    parser.add_argument("--platform", action="append", choices=PLATFORMS,
+                        help="A platform the plugin is built for.  Can be repeated.  Default: " +
+                             ", ".join(BUILT_PLATFORMS))
+    args = parser.parse_args()
+    overloads, commands = generate_bindings()
+    print("{}: {} AGK commands, {} overloads".format(os.path.relpath(BINDINGS_OUTPUT), commands, overloads))
+    rows = generate_commands(args.platform or BUILT_PLATFORMS)
+    print("{}: {} plugin commands".format(os.path.relpath(COMMANDS_OUTPUT), rows))
+
+
+if __name__ == "__main__":
+    main()